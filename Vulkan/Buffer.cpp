@@ -1,33 +1,30 @@
 #include "Buffer.h"
 #include "Utility.h"
 
-Buffer::Buffer(vk::PhysicalDevice physicalDevice, vk::Device device, vk::BufferCreateInfo buffer_info, vk::MemoryPropertyFlags properties)
-	: m_Buffer(device.createBuffer(buffer_info)), m_Device(device), m_Size(buffer_info.size)
+Buffer::Buffer(MemoryAllocator& allocator, vk::BufferCreateInfo buffer_info, vk::MemoryPropertyFlags properties)
+	: m_Buffer(allocator.device().createBuffer(buffer_info)), m_Allocator(allocator), m_Device(allocator.device()), m_Size(buffer_info.size)
 {
-	auto memRequirements = device.getBufferMemoryRequirements(m_Buffer);
+	auto memRequirements = m_Device.getBufferMemoryRequirements(m_Buffer);
 
-	vk::MemoryAllocateInfo allocInfo = {};
-	allocInfo
-		.setAllocationSize(memRequirements.size)
-		.setMemoryTypeIndex(findMemoryType(physicalDevice, memRequirements.memoryTypeBits, properties));
+	m_Allocation = allocator.allocate(memRequirements, properties, true);
 
-	m_Memory = device.allocateMemory(allocInfo);
-
-	device.bindBufferMemory(m_Buffer, m_Memory, 0);
+	m_Device.bindBufferMemory(m_Buffer, m_Allocation.memory, m_Allocation.offset);
 }
 
 Buffer::~Buffer()
 {
 	m_Device.destroyBuffer(m_Buffer);
-	m_Device.freeMemory(m_Memory);
+	m_Allocator.free(m_Allocation);
 }
 
 void* Buffer::map() const
 {
-	return m_Device.mapMemory(m_Memory, 0, VK_WHOLE_SIZE);
+	if (!m_Allocation.mapped) {
+		throw std::runtime_error("Buffer memory is not host visible and can't be mapped");
+	}
+	return m_Allocation.mapped;
 }
 
 void Buffer::unmap() const
 {
-	m_Device.unmapMemory(m_Memory);
 }
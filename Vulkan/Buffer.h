@@ -1,19 +1,22 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
+#include "MemoryAllocator.h"
 
 class Buffer
 {
 public:
-	Buffer(vk::PhysicalDevice physicalDevice, vk::Device device, vk::BufferCreateInfo buffer_info, vk::MemoryPropertyFlags properties);
+	Buffer(MemoryAllocator& allocator, vk::BufferCreateInfo buffer_info, vk::MemoryPropertyFlags properties);
 	~Buffer();
 
+	// host visible memory stays mapped for the lifetime of its block, unmap is only kept for symmetry
 	void* map() const;
 	void unmap() const;
 	vk::DeviceSize size() const { return m_Size; }
 
 	vk::Buffer m_Buffer;
-	vk::DeviceMemory m_Memory;
+	Allocation m_Allocation;
 private:
+	MemoryAllocator& m_Allocator;
 	vk::Device m_Device;
 	vk::DeviceSize m_Size;
 };
\ No newline at end of file
@@ -0,0 +1,32 @@
+@echo off
+cd %~dp0
+
+SET seconds=30
+SET cubeDim=30
+SET maxFrames=3
+SET exename=Vulkan
+SET /P "output=Output Folder (in data): "
+SET "drawArg=-cubeDim %cubeDim% -cubePad 1 -csv -fps -frameTime -sec %seconds%"
+
+DEL *.csv
+
+FOR /L %%i IN (1,1,%maxFrames%) DO CALL :run %%i
+ECHO Tests Complete!
+PAUSE
+EXIT
+
+:run
+START "Test #%1" /WAIT %exename%.exe %drawArg% -framesInFlight %1
+FOR /F "delims=_. tokens=2" %%i IN ('dir /B frameTime_*.csv') DO CALL :mover %%i %output% %1
+ECHO Test #%1 done!
+
+GOTO :EOF
+
+
+:mover
+IF NOT DEFINED dir set "dir=data\%2\%1"
+ mkdir %dir%\%3-frames
+ move fps_*.csv %dir%\%3-frames\
+ move frameTime_*.csv %dir%\%3-frames\
+ move conf_*.csv %dir%\%3-frames\
+ GOTO :EOF
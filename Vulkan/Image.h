@@ -1,26 +1,22 @@
 #pragma once
 #include <vulkan/vulkan.hpp>
 #include "Utility.h"
+#include "MemoryAllocator.h"
 
 class Image
 {
 public:
-	Image(vk::Device device, vk::PhysicalDevice physical_device, const vk::ImageCreateInfo& imageCreateInfo, vk::MemoryPropertyFlags properties, vk::ImageAspectFlagBits aspect_flags)
-		: m_Format(imageCreateInfo.format), m_Device(device)
+	Image(MemoryAllocator& allocator, const vk::ImageCreateInfo& imageCreateInfo, vk::MemoryPropertyFlags properties, vk::ImageAspectFlagBits aspect_flags)
+		: m_Format(imageCreateInfo.format), m_Allocator(allocator), m_Device(allocator.device())
 	{
+		auto device = m_Device;
 		m_Image = device.createImage(imageCreateInfo);
 
-		//copy to buffer
-		VkMemoryRequirements memRequirements = device.getImageMemoryRequirements(m_Image);
+		//optimally tiled images live in other blocks than buffers, see MemoryAllocator
+		auto memRequirements = device.getImageMemoryRequirements(m_Image);
+		m_Allocation = allocator.allocate(memRequirements, properties, imageCreateInfo.tiling == vk::ImageTiling::eLinear);
 
-		vk::MemoryAllocateInfo allocInfo = {};
-		allocInfo.allocationSize = memRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(physical_device, memRequirements.memoryTypeBits, properties);
-
-		
-		m_Memory = device.allocateMemory(allocInfo);
-
-		device.bindImageMemory(m_Image, m_Memory, 0);
+		device.bindImageMemory(m_Image, m_Allocation.memory, m_Allocation.offset);
 
 		vk::ImageSubresourceRange subresourceRange;
 		subresourceRange.setAspectMask(aspect_flags)
@@ -41,13 +37,14 @@ public:
 
 		m_Device.destroyImageView(m_ImageView);
 		m_Device.destroyImage(m_Image);
-		m_Device.freeMemory(m_Memory);
+		m_Allocator.free(m_Allocation);
     }
 
 	vk::Image m_Image;
-	vk::DeviceMemory m_Memory;
+	Allocation m_Allocation;
 	vk::ImageView m_ImageView;
 	vk::Format m_Format;
 private:
+	MemoryAllocator& m_Allocator;
 	vk::Device m_Device;
 };
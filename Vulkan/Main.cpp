@@ -5,6 +5,9 @@
 #include "../../scene-window-system/TestConfiguration.h"
 #include "../scene-window-system/Scene.h"
 #include "VulkanApplication.h"
+#include "TransformBenchmark.h"
+#include "PoolBenchmark.h"
+#include "Utility.h"
 
 const int WIDTH = 800;
 const int HEIGHT = 600;
@@ -49,5 +52,26 @@ int main(int argc, char *argv[]) {
 
 	TestConfiguration::SetTestConfiguration(arg.str().c_str());
 	auto& conf = TestConfiguration::GetInstance();
+
+	//no window and no device needed, only the cpu side of the matrices is timed
+	if (conf.transformBenchmark) {
+		SaveToFile("transformBenchmark.csv", RunTransformBenchmark(";"));
+		return 0;
+	}
+
+	if (conf.poolBenchmark) {
+		try {
+			SaveToFile("poolContention.csv", RunPoolContentionBenchmark(";"));
+			SaveToFile("poolLatency.csv", RunPoolLatencyBenchmark(";"));
+			SaveToFile("poolQueues.csv", RunPoolQueueBenchmark(";"));
+			SaveToFile("poolNestedWait.csv", RunPoolNestedWaitBenchmark(";"));
+		}
+		catch (const std::runtime_error& e) {
+			std::cerr << e.what() << std::endl;
+			return EXIT_FAILURE;
+		}
+		return 0;
+	}
+
 	runVulkanTest(conf);
 }
\ No newline at end of file
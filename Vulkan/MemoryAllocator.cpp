@@ -0,0 +1,213 @@
+#include "MemoryAllocator.h"
+#include "Utility.h"
+
+#include <algorithm>
+#include <sstream>
+
+MemoryBlock::MemoryBlock(vk::Device device, uint32_t memoryType, vk::DeviceSize size, bool hostVisible)
+	: m_Device(device), m_Size(size)
+{
+	vk::MemoryAllocateInfo allocInfo = {};
+	allocInfo
+		.setAllocationSize(size)
+		.setMemoryTypeIndex(memoryType);
+
+	m_Memory = device.allocateMemory(allocInfo);
+
+	if (hostVisible) {
+		m_Mapped = device.mapMemory(m_Memory, 0, VK_WHOLE_SIZE);
+	}
+
+	m_FreeRanges[0] = size;
+}
+
+MemoryBlock::~MemoryBlock()
+{
+	if (m_Mapped) {
+		m_Device.unmapMemory(m_Memory);
+	}
+	m_Device.freeMemory(m_Memory);
+}
+
+bool MemoryBlock::allocate(vk::DeviceSize size, vk::DeviceSize alignment, Allocation& allocation)
+{
+	for (auto it = m_FreeRanges.begin(); it != m_FreeRanges.end(); ++it) {
+		auto rangeOffset = it->first;
+		auto rangeEnd = it->first + it->second;
+		auto offset = (rangeOffset + alignment - 1) / alignment * alignment;
+		if (offset + size > rangeEnd) {
+			continue;
+		}
+
+		//the alignment padding stays free in front, the rest after the allocation
+		m_FreeRanges.erase(it);
+		if (offset > rangeOffset) {
+			m_FreeRanges[rangeOffset] = offset - rangeOffset;
+		}
+		if (offset + size < rangeEnd) {
+			m_FreeRanges[offset + size] = rangeEnd - (offset + size);
+		}
+
+		allocation.memory = m_Memory;
+		allocation.offset = offset;
+		allocation.size = size;
+		allocation.mapped = m_Mapped ? static_cast<uint8_t*>(m_Mapped) + offset : nullptr;
+		allocation.block = this;
+
+		m_UsedBytes += size;
+		++m_Allocations;
+		return true;
+	}
+
+	return false;
+}
+
+void MemoryBlock::free(vk::DeviceSize offset, vk::DeviceSize size)
+{
+	auto inserted = m_FreeRanges.emplace(offset, size).first;
+
+	//merge with the free range after it
+	auto next = std::next(inserted);
+	if (next != m_FreeRanges.end() && inserted->first + inserted->second == next->first) {
+		inserted->second += next->second;
+		m_FreeRanges.erase(next);
+	}
+
+	//and with the one before it
+	if (inserted != m_FreeRanges.begin()) {
+		auto previous = std::prev(inserted);
+		if (previous->first + previous->second == inserted->first) {
+			previous->second += inserted->second;
+			m_FreeRanges.erase(inserted);
+		}
+	}
+
+	m_UsedBytes -= size;
+	--m_Allocations;
+}
+
+MemoryAllocator::MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize)
+	: m_PhysicalDevice(physicalDevice), m_Device(device), m_MemoryProperties(physicalDevice.getMemoryProperties()), m_BlockSize(blockSize)
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+	//the blocks free their device memory, whatever is still allocated from them is gone with it
+	m_Pools.clear();
+}
+
+MemoryAllocator::Pool& MemoryAllocator::pool(uint32_t memoryType, bool linear)
+{
+	for (auto& pool : m_Pools) {
+		if (pool.memoryType == memoryType && pool.linear == linear) {
+			return pool;
+		}
+	}
+
+	m_Pools.push_back(Pool{ memoryType, linear, {} });
+	return m_Pools.back();
+}
+
+Allocation MemoryAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear)
+{
+	auto memoryType = findMemoryType(m_PhysicalDevice, requirements.memoryTypeBits, properties);
+	auto alignment = std::max<vk::DeviceSize>(requirements.alignment, 1);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto& memoryPool = pool(memoryType, linear);
+
+	Allocation allocation;
+	for (auto& block : memoryPool.blocks) {
+		if (block->allocate(requirements.size, alignment, allocation)) {
+			return allocation;
+		}
+	}
+
+	//no room left, a new block. Resources larger than a block get one of their own size.
+	//A block never takes more than an eighth of its heap, small heaps would run out of room otherwise
+	auto& memoryTypeInfo = m_MemoryProperties.memoryTypes[memoryType];
+	auto heapSize = m_MemoryProperties.memoryHeaps[memoryTypeInfo.heapIndex].size;
+	auto blockSize = std::max(std::min(m_BlockSize, heapSize / 8), requirements.size);
+	auto hostVisible = static_cast<bool>(memoryTypeInfo.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+
+	memoryPool.blocks.push_back(std::make_unique<MemoryBlock>(m_Device, memoryType, blockSize, hostVisible));
+	memoryPool.blocks.back()->allocate(requirements.size, alignment, allocation);
+	return allocation;
+}
+
+void MemoryAllocator::free(const Allocation& allocation)
+{
+	if (!allocation.block) {
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	allocation.block->free(allocation.offset, allocation.size);
+
+	//give empty blocks back to the device, but keep one per pool so allocating and freeing in turn doesn't thrash
+	for (auto& memoryPool : m_Pools) {
+		auto& blocks = memoryPool.blocks;
+		auto it = std::find_if(blocks.begin(), blocks.end(), [&](const std::unique_ptr<MemoryBlock>& block) { return block.get() == allocation.block; });
+		if (it != blocks.end()) {
+			if ((*it)->empty() && blocks.size() > 1) {
+				blocks.erase(it);
+			}
+			return;
+		}
+	}
+}
+
+void MemoryAllocator::addStatistics(MemoryStatistics& statistics, const MemoryBlock& block)
+{
+	++statistics.blocks;
+	statistics.allocations += block.allocations();
+	statistics.reservedBytes += block.size();
+	statistics.usedBytes += block.usedBytes();
+	statistics.freeRanges += block.freeRanges().size();
+	for (auto& range : block.freeRanges()) {
+		statistics.largestFreeRange = std::max(statistics.largestFreeRange, range.second);
+	}
+}
+
+MemoryStatistics MemoryAllocator::statistics() const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	MemoryStatistics statistics;
+	for (auto& memoryPool : m_Pools) {
+		for (auto& block : memoryPool.blocks) {
+			addStatistics(statistics, *block);
+		}
+	}
+	return statistics;
+}
+
+std::string MemoryAllocator::MakeString(std::string separator) const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::stringstream ss;
+
+	auto write = [&](const std::string& name, const MemoryStatistics& statistics) {
+		ss << name << " Blocks" << separator << statistics.blocks << "\n";
+		ss << name << " Allocations" << separator << statistics.allocations << "\n";
+		ss << name << " Reserved (bytes)" << separator << statistics.reservedBytes << "\n";
+		ss << name << " Used (bytes)" << separator << statistics.usedBytes << "\n";
+		ss << name << " Free Ranges" << separator << statistics.freeRanges << "\n";
+		ss << name << " Largest Free Range (bytes)" << separator << statistics.largestFreeRange << "\n";
+		ss << name << " Fragmentation" << separator << statistics.fragmentation() << "\n";
+	};
+
+	MemoryStatistics total;
+	for (auto& memoryPool : m_Pools) {
+		MemoryStatistics statistics;
+		for (auto& block : memoryPool.blocks) {
+			addStatistics(statistics, *block);
+			addStatistics(total, *block);
+		}
+		write("Memory Type " + std::to_string(memoryPool.memoryType) + (memoryPool.linear ? " Linear" : " Optimal"), statistics);
+	}
+	write("Memory", total);
+
+	return ss.str();
+}
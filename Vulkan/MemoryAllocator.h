@@ -0,0 +1,109 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class MemoryBlock;
+
+// A piece of a MemoryBlock, handed out by MemoryAllocator. Bind resources at memory + offset.
+struct Allocation
+{
+	vk::DeviceMemory memory;
+	vk::DeviceSize offset = 0;
+	vk::DeviceSize size = 0;
+	void* mapped = nullptr;	//<-- host address of offset, null unless the memory type is host visible
+	MemoryBlock* block = nullptr;
+};
+
+struct MemoryStatistics
+{
+	size_t blocks = 0;
+	size_t allocations = 0;
+	vk::DeviceSize reservedBytes = 0;	//<-- device memory allocated for the blocks
+	vk::DeviceSize usedBytes = 0;	//<-- handed out, alignment padding included
+	size_t freeRanges = 0;
+	vk::DeviceSize largestFreeRange = 0;
+
+	// 0 when all free memory is one range, towards 1 the more it is split up
+	double fragmentation() const
+	{
+		auto free = reservedBytes - usedBytes;
+		return free > 0 ? 1.0 - static_cast<double>(largestFreeRange) / free : 0.0;
+	}
+};
+
+/*
+ * Sub-allocates buffers and images from a few large device memory blocks instead of one vkAllocateMemory each,
+ * which keeps far below maxMemoryAllocationCount. Every memory type has separate pools for linear (buffers) and
+ * optimal (images) resources, so bufferImageGranularity never applies within a block. Blocks keep a free list
+ * sorted by offset: allocation is first fit with the requested alignment, freeing merges neighbouring ranges.
+ * Host visible blocks are mapped once when they are created and stay mapped.
+ */
+class MemoryAllocator
+{
+public:
+	MemoryAllocator(vk::PhysicalDevice physicalDevice, vk::Device device, vk::DeviceSize blockSize = 64 * 1024 * 1024);
+	MemoryAllocator(const MemoryAllocator&) = delete;
+	MemoryAllocator& operator=(const MemoryAllocator&) = delete;
+	~MemoryAllocator();
+
+	// linear: buffers and linearly tiled images, false for optimally tiled images
+	Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags properties, bool linear);
+	void free(const Allocation& allocation);
+
+	vk::Device device() const { return m_Device; }
+
+	MemoryStatistics statistics() const;
+
+	// one row per pool and a total, "Setting;Value" like the conf csv
+	std::string MakeString(std::string separator) const;
+
+private:
+	struct Pool
+	{
+		uint32_t memoryType;
+		bool linear;
+		std::vector<std::unique_ptr<MemoryBlock>> blocks;
+	};
+
+	Pool& pool(uint32_t memoryType, bool linear);
+	static void addStatistics(MemoryStatistics& statistics, const MemoryBlock& block);
+
+	vk::PhysicalDevice m_PhysicalDevice;
+	vk::Device m_Device;
+	vk::PhysicalDeviceMemoryProperties m_MemoryProperties;
+	vk::DeviceSize m_BlockSize;
+	std::vector<Pool> m_Pools;
+	mutable std::mutex m_Mutex;
+};
+
+class MemoryBlock
+{
+public:
+	MemoryBlock(vk::Device device, uint32_t memoryType, vk::DeviceSize size, bool hostVisible);
+	MemoryBlock(const MemoryBlock&) = delete;
+	MemoryBlock& operator=(const MemoryBlock&) = delete;
+	~MemoryBlock();
+
+	// false if no free range fits
+	bool allocate(vk::DeviceSize size, vk::DeviceSize alignment, Allocation& allocation);
+	void free(vk::DeviceSize offset, vk::DeviceSize size);
+
+	bool empty() const { return m_Allocations == 0; }
+	vk::DeviceSize size() const { return m_Size; }
+	vk::DeviceSize usedBytes() const { return m_UsedBytes; }
+	size_t allocations() const { return m_Allocations; }
+	const std::map<vk::DeviceSize, vk::DeviceSize>& freeRanges() const { return m_FreeRanges; }
+
+private:
+	vk::Device m_Device;
+	vk::DeviceMemory m_Memory;
+	vk::DeviceSize m_Size;
+	void* m_Mapped = nullptr;
+	std::map<vk::DeviceSize, vk::DeviceSize> m_FreeRanges;	//<-- offset -> size, never two adjacent ones
+	vk::DeviceSize m_UsedBytes = 0;
+	size_t m_Allocations = 0;
+};
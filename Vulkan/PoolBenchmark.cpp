@@ -0,0 +1,380 @@
+#include "PoolBenchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../scene-window-system/MpmcQueue.h"
+#include "../scene-window-system/ThreadPool.h"
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	const size_t threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+
+	// a few microseconds of work that the optimizer can't remove
+	void busyWork(size_t iterations)
+	{
+		volatile uint64_t sum = 0;
+		for (size_t i = 0; i < iterations; ++i) {
+			sum += i;
+		}
+	}
+
+	uint64_t nanosecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+	// raises maximum to value if it is larger, from any thread
+	void storeMax(std::atomic<uint64_t>& maximum, uint64_t value)
+	{
+		auto current = maximum.load();
+		while (current < value && !maximum.compare_exchange_weak(current, value)) {
+		}
+	}
+
+	// throws unless every one of the flags was set exactly once
+	void checkOnce(const std::vector<std::atomic<uint32_t>>& seen, const std::string& test)
+	{
+		size_t missing = 0, repeated = 0;
+		for (auto& count : seen) {
+			missing += count == 0 ? 1 : 0;
+			repeated += count > 1 ? 1 : 0;
+		}
+		if (missing > 0 || repeated > 0) {
+			throw std::runtime_error(test + ": " + std::to_string(missing) + " items lost, " + std::to_string(repeated) + " items seen more than once");
+		}
+	}
+
+	WorkerStatistics sum(const std::vector<WorkerStatistics>& statistics)
+	{
+		WorkerStatistics total;
+		for (auto& worker : statistics) {
+			total.tasks += worker.tasks;
+			total.runNanoseconds += worker.runNanoseconds;
+			total.waitNanoseconds += worker.waitNanoseconds;
+			total.idleNanoseconds += worker.idleNanoseconds;
+			total.contentions += worker.contentions;
+		}
+		return total;
+	}
+}
+
+std::string RunPoolContentionBenchmark(std::string separator)
+{
+	const size_t frames = 200;
+	const size_t tasksPerWorker = 16;	//<-- per frame, like 16 record chunks per draw thread
+	const size_t workIterations = 2000;
+
+	std::stringstream ss;
+	ss << "Threads" << separator << "Tasks" << separator << "Wall (ns)" << separator << "Tasks/s"
+		<< separator << "Worker Tasks" << separator << "Run (ns)" << separator << "Wait (ns)" << separator << "Idle (ns)"
+		<< separator << "Contentions" << separator << "Contentions/Task" << separator << "Wait Share" << "\n";
+
+	for (auto threads : threadCounts) {
+		ThreadPool pool(threads);
+		pool.set_statistics_enabled(true);
+
+		auto tasks = frames * tasksPerWorker * threads;
+		auto before = pool.worker_statistics();
+		auto start = Clock::now();
+
+		for (size_t frame = 0; frame < frames; ++frame) {
+			TaskCounter counter;
+			for (size_t i = 0; i < tasksPerWorker * threads; ++i) {
+				pool.submit(counter, [] { busyWork(workIterations); });
+			}
+			pool.wait(counter);
+		}
+
+		auto wall = nanosecondsSince(start);
+		auto after = pool.worker_statistics();
+		std::vector<WorkerStatistics> delta;
+		for (size_t i = 0; i < after.size(); ++i) {
+			delta.push_back(after[i] - before[i]);
+		}
+		auto total = sum(delta);
+
+		//the waiting main thread runs tasks too, those are in Tasks but not in the worker columns
+		auto busy = total.runNanoseconds + total.waitNanoseconds;
+		ss << threads << separator << tasks << separator << wall << separator << tasks * 1e9 / std::max<uint64_t>(wall, 1)
+			<< separator << total.tasks << separator << total.runNanoseconds << separator << total.waitNanoseconds << separator << total.idleNanoseconds
+			<< separator << total.contentions << separator << static_cast<double>(total.contentions) / tasks
+			<< separator << (busy > 0 ? static_cast<double>(total.waitNanoseconds) / busy : 0.0) << "\n";
+	}
+
+	return ss.str();
+}
+
+std::string RunPoolLatencyBenchmark(std::string separator)
+{
+	const size_t frames = 20;
+	const size_t backgroundPerFrame = 64;
+	const size_t tasksPerWorker = 16;
+	const size_t workIterations = 2000;
+	const auto frameBound = std::chrono::milliseconds(500);	//<-- longest a frame may take while the background lane is busy
+	const auto backgroundHold = std::chrono::seconds(2);	//<-- well past the bound, so a frame waiting for a background task fails
+
+	//what the tasks of one frame share, one pointer fits any task
+	struct Frame
+	{
+		TaskCounter counter;
+		std::atomic<size_t> backgroundStarted { 0 };
+		std::atomic<bool> release { false };
+		std::atomic<uint64_t> frameLatency { 0 };
+		std::atomic<uint64_t> frameMax { 0 };
+		std::atomic<uint64_t> pinnedLatency { 0 };
+		std::atomic<uint64_t> pinnedMax { 0 };
+	};
+
+	std::stringstream ss;
+	ss << "Threads" << separator << "Frames" << separator << "Frame Tasks" << separator << "Background Tasks"
+		<< separator << "Frame Avg (ns)" << separator << "Frame Max (ns)"
+		<< separator << "Unpinned Avg (ns)" << separator << "Unpinned Max (ns)" << separator << "Pinned Avg (ns)" << separator << "Pinned Max (ns)" << "\n";
+
+	for (auto threads : threadCounts) {
+		ThreadPool pool(threads);
+		uint64_t frameTotal = 0, frameMax = 0, unpinnedTotal = 0, unpinnedMax = 0, pinnedTotal = 0, pinnedMax = 0;
+
+		for (size_t frame = 0; frame < frames; ++frame) {
+			Frame state;
+			auto statePtr = &state;
+			TaskCounter backgroundCounter;
+
+			//a flood of background tasks that hold their thread until the frame is done
+			for (size_t i = 0; i < backgroundPerFrame; ++i) {
+				pool.submit(backgroundCounter, [statePtr, backgroundHold] {
+					++statePtr->backgroundStarted;
+					auto start = Clock::now();
+					while (!statePtr->release && Clock::now() - start < backgroundHold) {
+						std::this_thread::yield();
+					}
+				}, TaskPriority::Background);
+			}
+
+			//the frame only starts once background work is running, like record nodes pinned while a telemetry sample is taken
+			auto start = Clock::now();
+			while (state.backgroundStarted == 0 && Clock::now() - start < frameBound) {
+				std::this_thread::yield();
+			}
+			if (state.backgroundStarted == 0) {
+				state.release = true;
+				pool.wait(backgroundCounter);
+				throw std::runtime_error("ThreadPool latency: no background task started at " + std::to_string(threads) + " threads");
+			}
+
+			auto submitted = Clock::now();
+			for (size_t worker = 0; worker < threads; ++worker) {
+				pool.submit_to(worker, state.counter, [statePtr, submitted, workIterations] {
+					auto latency = nanosecondsSince(submitted);
+					statePtr->pinnedLatency += latency;
+					storeMax(statePtr->pinnedMax, latency);
+					busyWork(workIterations);
+				});
+			}
+			for (size_t i = 0; i < tasksPerWorker * threads; ++i) {
+				pool.submit(state.counter, [statePtr, submitted, workIterations] {
+					auto latency = nanosecondsSince(submitted);
+					statePtr->frameLatency += latency;
+					storeMax(statePtr->frameMax, latency);
+					busyWork(workIterations);
+				});
+			}
+
+			//poll instead of wait: the calling thread would run the frame tasks itself and hide a blocked pool
+			while (!state.counter.done() && Clock::now() - submitted < frameBound) {
+				std::this_thread::yield();
+			}
+			auto finished = state.counter.done();
+			auto wall = nanosecondsSince(submitted);
+
+			state.release = true;
+			pool.wait(state.counter);
+			pool.wait(backgroundCounter);
+			if (!finished) {
+				throw std::runtime_error("ThreadPool latency: a frame took longer than " + std::to_string(frameBound.count()) + " ms behind background tasks at " + std::to_string(threads) + " threads");
+			}
+
+			frameTotal += wall;
+			frameMax = std::max(frameMax, wall);
+			unpinnedTotal += state.frameLatency;
+			unpinnedMax = std::max<uint64_t>(unpinnedMax, state.frameMax);
+			pinnedTotal += state.pinnedLatency;
+			pinnedMax = std::max<uint64_t>(pinnedMax, state.pinnedMax);
+		}
+
+		auto unpinnedTasks = frames * tasksPerWorker * threads;
+		auto pinnedTasks = frames * threads;
+		ss << threads << separator << frames << separator << unpinnedTasks + pinnedTasks << separator << frames * backgroundPerFrame
+			<< separator << frameTotal / frames << separator << frameMax
+			<< separator << unpinnedTotal / unpinnedTasks << separator << unpinnedMax
+			<< separator << pinnedTotal / pinnedTasks << separator << pinnedMax << "\n";
+	}
+
+	return ss.str();
+}
+
+std::string RunPoolQueueBenchmark(std::string separator)
+{
+	const size_t itemsPerProducer = 20000;
+	const size_t ringCapacity = 64;	//<-- small, so producers and consumers keep running into a full and an empty ring
+
+	std::stringstream ss;
+	ss << "Queue" << separator << "Threads" << separator << "Producers" << separator << "Consumers" << separator << "Items"
+		<< separator << "Wall (ns)" << separator << "Items/s" << "\n";
+
+	auto row = [&](const std::string& queue, size_t threads, size_t producers, size_t consumers, size_t items, uint64_t wall) {
+		ss << queue << separator << threads << separator << producers << separator << consumers << separator << items
+			<< separator << wall << separator << items * 1e9 / std::max<uint64_t>(wall, 1) << "\n";
+	};
+
+	//the bare ring: as many producer as consumer threads, every value has to come out exactly once
+	for (auto threads : threadCounts) {
+		auto items = threads * itemsPerProducer;
+		MpmcQueue<size_t> queue(ringCapacity);
+		std::vector<std::atomic<uint32_t>> seen(items);
+		std::atomic<size_t> consumed(0);
+		std::vector<std::thread> producers, consumers;
+
+		auto start = Clock::now();
+		for (size_t p = 0; p < threads; ++p) {
+			producers.emplace_back([&queue, p, itemsPerProducer] {
+				for (auto value = p * itemsPerProducer; value < (p + 1) * itemsPerProducer; ++value) {
+					auto item = value;
+					while (!queue.try_push(std::move(item))) {
+						std::this_thread::yield();
+					}
+				}
+			});
+			consumers.emplace_back([&queue, &seen, &consumed, items] {
+				size_t value;
+				while (consumed < items) {
+					if (queue.try_pop(value)) {
+						++seen[value];
+						++consumed;
+					}
+					else {
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		for (auto& thread : producers) {
+			thread.join();
+		}
+		for (auto& thread : consumers) {
+			thread.join();
+		}
+		auto wall = nanosecondsSince(start);
+
+		checkOnce(seen, "MpmcQueue with " + std::to_string(threads) + " producers and consumers");
+		row("MpmcQueue", threads, threads, threads, items, wall);
+	}
+
+	//the pool: as many outside threads as workers submit small tasks against their own counter and wait for them,
+	//so workers and the waiting producers consume together
+	for (auto backend : { QueueBackend::WorkStealing, QueueBackend::LockFree }) {
+		for (auto threads : threadCounts) {
+			auto items = threads * itemsPerProducer;
+			std::vector<std::atomic<uint32_t>> seen(items);
+			std::vector<std::thread> producers;
+			std::atomic<size_t> unfinished(0);
+			uint64_t wall = 0;
+			{
+				ThreadPool pool(threads, {}, backend);
+				auto start = Clock::now();
+				for (size_t p = 0; p < threads; ++p) {
+					producers.emplace_back([&pool, &seen, &unfinished, p, itemsPerProducer] {
+						TaskCounter counter;
+						for (auto value = p * itemsPerProducer; value < (p + 1) * itemsPerProducer; ++value) {
+							auto flag = &seen[value];
+							pool.submit(counter, [flag] { ++*flag; });
+						}
+						pool.wait(counter);
+						if (!counter.done()) {
+							++unfinished;
+						}
+					});
+				}
+				for (auto& thread : producers) {
+					thread.join();
+				}
+				wall = nanosecondsSince(start);
+			}
+
+			auto test = std::string("ThreadPool ") + ToString(backend) + " with " + std::to_string(threads) + " threads";
+			if (unfinished > 0) {
+				throw std::runtime_error(test + ": wait returned before its tasks were done");
+			}
+			checkOnce(seen, test);
+			row(std::string("ThreadPool ") + ToString(backend), threads, threads, threads, items, wall);
+		}
+	}
+
+	return ss.str();
+}
+
+std::string RunPoolNestedWaitBenchmark(std::string separator)
+{
+	const size_t frames = 100;
+	const size_t innerTasks = 4;	//<-- per kind, per outer task
+	const size_t workIterations = 2000;
+	const auto timeout = std::chrono::seconds(2);	//<-- a frame taking this long is a deadlocked pool
+
+	std::stringstream ss;
+	ss << "Threads" << separator << "Frames" << separator << "Tasks" << separator << "Wall (ns)" << separator << "Tasks/s" << "\n";
+
+	for (auto threads : threadCounts) {
+		//a deadlocked worker never returns, so on failure the pool is leaked instead of joined
+		std::unique_ptr<ThreadPool> pool(new ThreadPool(threads));
+		auto poolPtr = pool.get();
+		std::atomic<size_t> ran(0);
+		auto ranPtr = &ran;
+
+		auto start = Clock::now();
+		for (size_t frame = 0; frame < frames; ++frame) {
+			TaskCounter counter;
+
+			//every worker gets a task that waits for work pinned to the same worker, like a record node
+			//splitting its range, plus unpinned work anybody may take
+			for (size_t worker = 0; worker < threads; ++worker) {
+				pool->submit_to(worker, counter, [poolPtr, ranPtr, worker, innerTasks, workIterations] {
+					TaskCounter inner;
+					for (size_t i = 0; i < innerTasks; ++i) {
+						poolPtr->submit_to(worker, inner, [ranPtr, workIterations] { busyWork(workIterations); ++*ranPtr; });
+						poolPtr->submit(inner, [ranPtr, workIterations] { busyWork(workIterations); ++*ranPtr; });
+					}
+					poolPtr->wait(inner);
+					++*ranPtr;
+				});
+			}
+
+			auto frameStart = Clock::now();
+			while (!counter.done() && Clock::now() - frameStart < timeout) {
+				std::this_thread::yield();
+			}
+			if (!counter.done()) {
+				pool.release();
+				throw std::runtime_error("ThreadPool nested wait: a worker waiting for tasks pinned to itself deadlocked at " + std::to_string(threads) + " threads");
+			}
+		}
+		auto wall = nanosecondsSince(start);
+
+		auto tasks = frames * threads * (2 * innerTasks + 1);
+		if (ran != tasks) {
+			throw std::runtime_error("ThreadPool nested wait: " + std::to_string(ran.load()) + " of " + std::to_string(tasks) + " tasks ran at " + std::to_string(threads) + " threads");
+		}
+		ss << threads << separator << frames << separator << tasks << separator << wall << separator << tasks * 1e9 / std::max<uint64_t>(wall, 1) << "\n";
+	}
+
+	return ss.str();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+/*
+ * ThreadPool checks and timings for -poolBenchmark (see Main.cpp), no window or device needed.
+ * Every function returns csv; the checks throw std::runtime_error when the pool misbehaves.
+ */
+
+// Frames of small tasks submitted from outside the pool and waited for, like recordCommandBuffers, at 1 to 32
+// workers. Reports the WorkerStatistics of the workers: run time, wait time (searching, failed steals, spinning),
+// parked time and how often a worker ring was found locked.
+std::string RunPoolContentionBenchmark(std::string separator);
+
+// Frames of pinned and unpinned tasks submitted while a flood of background tasks runs, each holding its thread
+// until the frame is done, 1 to 32 workers. Every frame starts only after a background task has started, so a
+// worker running background work would hold the task pinned to it. Throws if a frame misses its bound. Reports
+// the frame time and the submit to start latency of the pinned and unpinned tasks.
+std::string RunPoolLatencyBenchmark(std::string separator);
+
+// Stress and throughput of the task queues at 1 to 32 threads: a bare MpmcQueue with as many producer as consumer
+// threads, then a ThreadPool of either QueueBackend fed by as many outside threads as it has workers, each waiting
+// for its own tasks. Throws if an item is lost or consumed twice. Reports items per second.
+std::string RunPoolQueueBenchmark(std::string separator);
+
+// Tasks pinned to each worker that submit tasks pinned to the same worker (and unpinned ones) and wait for them,
+// 1 to 32 workers. Throws if a frame deadlocks or a task goes missing.
+std::string RunPoolNestedWaitBenchmark(std::string separator);
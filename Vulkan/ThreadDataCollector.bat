@@ -28,4 +28,7 @@ IF NOT DEFINED dir set "dir=data\%2\%1"
  mkdir %dir%\%3-threads
  move frameTime_*.csv %dir%\%3-threads\
  move conf_*.csv %dir%\%3-threads\
+ IF EXIST threadStats_*.csv move threadStats_*.csv %dir%\%3-threads\
+ IF EXIST rerecord_*.csv move rerecord_*.csv %dir%\%3-threads\
+ IF EXIST gpuTime_*.csv move gpuTime_*.csv %dir%\%3-threads\
  GOTO :EOF
\ No newline at end of file
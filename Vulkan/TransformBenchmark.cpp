@@ -0,0 +1,91 @@
+#include "TransformBenchmark.h"
+
+#define GLM_FORCE_RADIANS
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <sstream>
+#include <vector>
+
+#include "../scene-window-system/TransformStore.h"
+
+namespace
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	const size_t stride = 256;	//<-- the dynamic allignment of a mat4 on most desktop GPUs (minUniformBufferOffsetAlignment)
+	const size_t updates = 20;	//<-- timed updates per object count and method
+
+	// The matrix loop as it was before TransformStore: glm::translate and glm::rotate per object, std::pow for the direction
+	void updateReference(const std::vector<RenderObject>& renderObjects, std::vector<int>& angles, uint8_t* destination)
+	{
+		for (size_t index = 0; index < renderObjects.size(); index++)
+		{
+			auto& render_object = renderObjects[index];
+			auto model = translate(glm::mat4(), { render_object.x(), render_object.y(), render_object.z() });
+			angles[index] = (angles[index] + 1) % 360;
+
+			auto rotateX = 0.0001f*(index + 1) * std::pow(-1, index);
+			auto rotateY = 0.0002f*(index + 1) * std::pow(-1, index);
+			auto rotateZ = 0.0003f*(index + 1) * std::pow(-1, index);
+			model = glm::rotate<float>(model, angles[index] * 3.14159268 / 180, glm::tvec3<float>{ rotateX, rotateY, rotateZ });
+
+			*reinterpret_cast<glm::mat4*>(destination + index * stride) = model;
+		}
+	}
+
+	template<typename Update>
+	uint64_t meanNanoseconds(Update update)
+	{
+		update();	//<-- warm up, touches all of the destination once
+
+		auto start = Clock::now();
+		for (size_t i = 1; i < updates; ++i) {
+			update();
+		}
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / (updates - 1);
+	}
+}
+
+std::string RunTransformBenchmark(std::string separator)
+{
+	std::stringstream ss;
+	ss << "Objects" << separator << "Method" << separator << "Mean (ns)" << separator << "Per Object (ns)"
+		<< separator << "Speedup" << separator << "Max Difference" << "\n";
+
+	for (size_t objectCount : { 10000, 100000, 1000000 }) {
+		std::vector<RenderObject> renderObjects;
+		renderObjects.reserve(objectCount);
+		for (size_t i = 0; i < objectCount; ++i) {
+			renderObjects.push_back(RenderObject(static_cast<float>(i % 100), static_cast<float>(i / 100 % 100), static_cast<float>(i / 10000)));
+		}
+
+		std::vector<uint8_t> referenceMatrices(objectCount * stride);
+		std::vector<int> angles(objectCount, 0);
+		auto reference = meanNanoseconds([&] { updateReference(renderObjects, angles, referenceMatrices.data()); });
+
+		std::vector<uint8_t> storeMatrices(objectCount * stride);
+		TransformStore store(renderObjects);
+		auto batched = meanNanoseconds([&] { store.update(0, objectCount, storeMatrices.data(), stride, true); });
+
+		float difference = 0.0f;
+		for (size_t i = 0; i < objectCount; ++i) {
+			auto a = reinterpret_cast<const float*>(referenceMatrices.data() + i * stride);
+			auto b = reinterpret_cast<const float*>(storeMatrices.data() + i * stride);
+			for (auto element = 0; element < 16; ++element) {
+				difference = std::max(difference, std::abs(a[element] - b[element]));
+			}
+		}
+
+		ss << objectCount << separator << "glm" << separator << reference << separator << static_cast<double>(reference) / objectCount
+			<< separator << 1.0 << separator << 0.0 << "\n";
+		ss << objectCount << separator << "TransformStore" << separator << batched << separator << static_cast<double>(batched) / objectCount
+			<< separator << static_cast<double>(reference) / std::max<uint64_t>(batched, 1) << separator << difference << "\n";
+	}
+
+	return ss.str();
+}
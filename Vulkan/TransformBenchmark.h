@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+
+// Times the model matrix generation of TransformStore against the per object glm loop it replaced, for 10^4, 10^5
+// and 10^6 objects, single threaded. Returns csv with one row per object count and method; the max difference
+// column compares the matrices of both methods after the same number of updates.
+std::string RunTransformBenchmark(std::string separator);
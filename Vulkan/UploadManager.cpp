@@ -0,0 +1,264 @@
+#include "UploadManager.h"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+	const vk::DeviceSize stagingAlignment = 16;	//<-- covers the 4 byte and texel size alignment of buffer to image copies
+}
+
+UploadManager::UploadManager(MemoryAllocator& allocator, vk::Queue queue, uint32_t queueFamily, vk::DeviceSize stagingSize)
+	: m_Allocator(allocator), m_Device(allocator.device()), m_Queue(queue)
+{
+	vk::CommandPoolCreateInfo poolInfo = {};
+	poolInfo.queueFamilyIndex = queueFamily;
+	poolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+	m_CommandPool = m_Device.createCommandPool(poolInfo);
+
+	vk::BufferCreateInfo bufferInfo = {};
+	bufferInfo.size = stagingSize;
+	bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+	m_Staging = std::make_unique<Buffer>(allocator, bufferInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+	m_StagingData = static_cast<uint8_t*>(m_Staging->map());
+}
+
+UploadManager::~UploadManager()
+{
+	//recorded but never submitted commands are dropped, the pool takes their command buffer with it
+	wait();
+
+	for (auto fence : m_FreeFences) {
+		m_Device.destroyFence(fence);
+	}
+	m_Device.destroyCommandPool(m_CommandPool);
+}
+
+vk::CommandBuffer UploadManager::commandBuffer()
+{
+	if (m_Recording.commandBuffer) {
+		return m_Recording.commandBuffer;
+	}
+
+	if (m_FreeCommandBuffers.empty()) {
+		vk::CommandBufferAllocateInfo allocInfo = {};
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+		allocInfo.commandPool = m_CommandPool;
+		allocInfo.commandBufferCount = 1;
+		m_FreeCommandBuffers.push_back(m_Device.allocateCommandBuffers(allocInfo)[0]);
+	}
+
+	m_Recording.commandBuffer = m_FreeCommandBuffers.back();
+	m_FreeCommandBuffers.pop_back();
+
+	vk::CommandBufferBeginInfo beginInfo = {};
+	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+	m_Recording.commandBuffer.begin(beginInfo);
+	return m_Recording.commandBuffer;
+}
+
+std::pair<vk::Buffer, vk::DeviceSize> UploadManager::stage(const void* data, vk::DeviceSize size)
+{
+	m_StagedBytes += size;
+	auto ringSize = m_Staging->size();
+
+	if (size > ringSize) {
+		vk::BufferCreateInfo bufferInfo = {};
+		bufferInfo.size = size;
+		bufferInfo.usage = vk::BufferUsageFlagBits::eTransferSrc;
+		m_Recording.ownStaging.push_back(std::make_unique<Buffer>(m_Allocator, bufferInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		memcpy(m_Recording.ownStaging.back()->map(), data, size);
+		return { m_Recording.ownStaging.back()->m_Buffer, 0 };
+	}
+
+	for (;;) {
+		//the free part of the ring starts at m_Head and wraps around to the oldest batch still in use
+		auto offset = (m_Head + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+		if (offset + size > ringSize) {
+			offset = 0;
+		}
+		auto needed = (offset >= m_Head ? offset - m_Head : ringSize - m_Head) + size;
+
+		if (m_InUse + needed <= ringSize) {
+			m_Head = offset + size;
+			m_InUse += needed;
+			m_Recording.stagingBytes += needed;
+			memcpy(m_StagingData + offset, data, size);
+			return { m_Staging->m_Buffer, offset };
+		}
+
+		//full: what was recorded so far has to go first, then the oldest batches free their part
+		if (m_Recording.commandBuffer) {
+			submitRecorded();
+		}
+		if (!m_Submitted.empty()) {
+			retireOldest();
+		}
+		else {
+			m_Head = 0;	//<-- nothing in use any more, start over at the front
+		}
+	}
+}
+
+void UploadManager::uploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer destination, vk::DeviceSize destinationOffset)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	auto staging = stage(data, size);
+
+	vk::BufferCopy copyRegion;
+	copyRegion.srcOffset = staging.second;
+	copyRegion.dstOffset = destinationOffset;
+	copyRegion.size = size;
+
+	commandBuffer().copyBuffer(staging.first, destination, { copyRegion });
+	m_Recording.hasCopies = true;
+	++m_Commands;
+}
+
+void UploadManager::uploadImage(const void* data, vk::DeviceSize size, vk::Image image, vk::ImageAspectFlags aspect, uint32_t width, uint32_t height)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	auto staging = stage(data, size);
+
+	vk::BufferImageCopy region;
+	region.bufferOffset = staging.second;
+	region.bufferRowLength = 0;
+	region.bufferImageHeight = 0;
+	region.imageSubresource.aspectMask = aspect;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
+	region.imageSubresource.layerCount = 1;
+	region.imageOffset = vk::Offset3D { 0,0,0 };
+	region.imageExtent = vk::Extent3D {
+		width,
+		height,
+		1
+	};
+
+	commandBuffer().copyBufferToImage(staging.first, image, vk::ImageLayout::eTransferDstOptimal, { region });
+	m_Recording.hasCopies = true;
+	++m_Commands;
+}
+
+void UploadManager::transitionImageLayout(vk::Image image, vk::ImageAspectFlags aspect, vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
+{
+	vk::PipelineStageFlags sourceStage;
+	vk::PipelineStageFlags destinationStage;
+	vk::AccessFlags source_access_mask;
+	vk::AccessFlags destination_access_mask;
+
+	if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal) {
+		source_access_mask = vk::AccessFlags();
+		destination_access_mask = vk::AccessFlagBits::eTransferWrite;
+
+		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
+		destinationStage = vk::PipelineStageFlagBits::eTransfer;
+	}
+	else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
+		source_access_mask = vk::AccessFlagBits::eTransferWrite;
+		destination_access_mask = vk::AccessFlagBits::eShaderRead;
+
+		sourceStage = vk::PipelineStageFlagBits::eTransfer;
+		destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
+	}
+	else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
+		source_access_mask = vk::AccessFlags();
+		destination_access_mask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
+		destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
+	}
+	else {
+		throw std::invalid_argument("unsupported layout transition!");
+	}
+
+	auto image_memory_barrier = vk::ImageMemoryBarrier(
+		source_access_mask,
+		destination_access_mask,
+		oldLayout,
+		newLayout,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		{ aspect, 0, 1, 0, 1 });
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	commandBuffer().pipelineBarrier(sourceStage, destinationStage, vk::DependencyFlags(), {}, {}, { image_memory_barrier });
+	++m_Commands;
+}
+
+void UploadManager::submit()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (m_Recording.commandBuffer) {
+		submitRecorded();
+	}
+}
+
+void UploadManager::submitRecorded()
+{
+	auto commandBuffer = m_Recording.commandBuffer;
+
+	//buffer copies have no barrier of their own: make them visible to whatever reads the buffers later on this queue
+	if (m_Recording.hasCopies) {
+		vk::MemoryBarrier barrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eMemoryRead);
+		commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), { barrier }, {}, {});
+	}
+	commandBuffer.end();
+
+	if (m_FreeFences.empty()) {
+		m_FreeFences.push_back(m_Device.createFence({}));
+	}
+	m_Recording.fence = m_FreeFences.back();
+	m_FreeFences.pop_back();
+
+	vk::SubmitInfo submitInfo;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	m_Queue.submit({ submitInfo }, m_Recording.fence);
+	++m_Submissions;
+
+	m_Submitted.push_back(std::move(m_Recording));
+	m_Recording = Batch();
+}
+
+void UploadManager::retireOldest()
+{
+	auto& batch = m_Submitted.front();
+
+	m_Device.waitForFences({ batch.fence }, VK_TRUE, UINT64_MAX);
+	m_Device.resetFences({ batch.fence });
+	++m_Waits;
+
+	batch.commandBuffer.reset(vk::CommandBufferResetFlags());
+	m_FreeCommandBuffers.push_back(batch.commandBuffer);
+	m_FreeFences.push_back(batch.fence);
+	m_InUse -= batch.stagingBytes;
+
+	m_Submitted.pop_front();
+}
+
+void UploadManager::wait()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (!m_Submitted.empty()) {
+		retireOldest();
+	}
+}
+
+std::string UploadManager::MakeString(std::string separator) const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::stringstream ss;
+
+	ss << "Upload Commands" << separator << m_Commands << "\n";
+	ss << "Upload Submissions" << separator << m_Submissions << "\n";
+	ss << "Upload Fence Waits" << separator << m_Waits << "\n";
+	ss << "Upload Staged (bytes)" << separator << m_StagedBytes << "\n";
+	ss << "Upload Staging Ring (bytes)" << separator << m_Staging->size() << "\n";
+
+	return ss.str();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Buffer.h"
+#include "MemoryAllocator.h"
+
+/*
+ * Collects buffer uploads, image uploads and layout transitions in one command buffer and submits them together
+ * with a single fence, instead of one submission and a queue waitIdle per operation. Upload data is copied into a
+ * persistently mapped staging ring right away, so the caller's memory can go as soon as the call returns.
+ * When the ring runs out of room the recorded batch is submitted and the oldest batches are waited for; uploads
+ * larger than the whole ring get a staging buffer of their own, freed with their batch.
+ * Commands only reach the GPU on submit() (or flush()); wait() blocks until every submitted batch is done.
+ */
+class UploadManager
+{
+public:
+	UploadManager(MemoryAllocator& allocator, vk::Queue queue, uint32_t queueFamily, vk::DeviceSize stagingSize = 16 * 1024 * 1024);
+	UploadManager(const UploadManager&) = delete;
+	UploadManager& operator=(const UploadManager&) = delete;
+	~UploadManager();
+
+	void uploadBuffer(const void* data, vk::DeviceSize size, vk::Buffer destination, vk::DeviceSize destinationOffset = 0);
+
+	// Tightly packed texels of mip level 0, layer 0. The image has to be in eTransferDstOptimal (see transitionImageLayout)
+	void uploadImage(const void* data, vk::DeviceSize size, vk::Image image, vk::ImageAspectFlags aspect, uint32_t width, uint32_t height);
+
+	// The transitions images go through while being created and filled, others throw std::invalid_argument
+	void transitionImageLayout(vk::Image image, vk::ImageAspectFlags aspect, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
+
+	// Submits the recorded commands, if any, without waiting for them
+	void submit();
+	// Waits until every submitted batch has finished
+	void wait();
+	void flush() { submit(); wait(); }
+
+	// "Setting;Value" rows like the conf csv
+	std::string MakeString(std::string separator) const;
+
+private:
+	struct Batch
+	{
+		vk::CommandBuffer commandBuffer;
+		vk::Fence fence;
+		vk::DeviceSize stagingBytes = 0;	//<-- ring bytes used by the batch, alignment padding included
+		std::vector<std::unique_ptr<Buffer>> ownStaging;	//<-- staging of uploads larger than the ring
+		bool hasCopies = false;
+	};
+
+	vk::CommandBuffer commandBuffer();
+	// Staging memory for size bytes: an offset into the ring, or a new buffer in ownStaging of the recorded batch
+	std::pair<vk::Buffer, vk::DeviceSize> stage(const void* data, vk::DeviceSize size);
+	void submitRecorded();
+	void retireOldest();
+
+	MemoryAllocator& m_Allocator;
+	vk::Device m_Device;
+	vk::Queue m_Queue;
+	vk::CommandPool m_CommandPool;
+
+	std::unique_ptr<Buffer> m_Staging;
+	uint8_t* m_StagingData = nullptr;
+	vk::DeviceSize m_Head = 0;	//<-- next free byte of the ring
+	vk::DeviceSize m_InUse = 0;	//<-- bytes from the oldest unfinished batch up to m_Head
+
+	Batch m_Recording;	//<-- commandBuffer stays null until something is recorded
+	std::deque<Batch> m_Submitted;	//<-- oldest first
+	std::vector<vk::Fence> m_FreeFences;
+	std::vector<vk::CommandBuffer> m_FreeCommandBuffers;
+
+	size_t m_Commands = 0;
+	size_t m_Submissions = 0;
+	size_t m_Waits = 0;
+	vk::DeviceSize m_StagedBytes = 0;
+	mutable std::mutex m_Mutex;
+};
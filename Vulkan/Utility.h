@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <fstream>
+#include <glm/glm.hpp>
 #include "../scene-window-system/RenderObject.h"
 
 struct PipelineStatisticsResult
@@ -22,24 +23,41 @@ struct DrawRenderObjectsInfo
 {
 	const RenderObject* roArr = nullptr;
 	size_t roArrCount = 0;
-	size_t roArrStride = 0;	//<-- the last thread can have a difference between count and stride
+	size_t firstObject = 0;	//<-- index of roArr[0] in the scene, selects its model matrix
 	uint32_t dynamicAllignment;
 	vk::CommandBuffer* commandBuffer;
 	uint32_t numOfIndices = 0;
 	vk::PipelineLayout* pipelineLayout;
 	vk::DescriptorSet* descriptorSet;
 	vk::QueryPool* queryPool;
+	vk::QueryPool* timestampQueryPool;	//<-- null without -gpuTimestamps
+	uint32_t firstTimestamp;	//<-- start and end timestamp of the range are written here
 	uint32_t frameIndex;
-	uint32_t threadId;
+	uint32_t threadId;	//<-- index of the range, also its pipeline statistics query
 	vk::RenderPass* renderPass;
-	vk::RenderPassBeginInfo* renderPassBeginInfo;
 	vk::Pipeline* pipeline;
 	vk::Buffer* vertexBuffer;
 	vk::Buffer* indexBuffer;
+	vk::Buffer* instanceBuffer;	//<-- model matrices, read as per instance vertex data with -instanced
+	vk::DrawIndexedIndirectCommand* indirectCommands;	//<-- first command of the range, -indirect only
+	const glm::mat4* modelMatrices;	//<-- matrix of the first render object of the range, dynamicAllignment apart
 	vk::Framebuffer* framebuffer;
+	bool ownRenderPass = false;	//<-- -primaryPerThread: a primary buffer that begins and ends renderPass itself
+	vk::Extent2D renderArea;
+	bool endsDrawPass = false;	//<-- -primaryPerThread: the last range also writes the end of draw pass timestamp
+	uint32_t drawPassEndTimestamp = 0;
 	uint64_t dynamicUniformBufferStride;
 };
 
+//what a secondary command buffer was last recorded with, see TestConfiguration::cacheCommandBuffers
+struct RecordedRange
+{
+	size_t first = 0;
+	size_t last = 0;
+	uint64_t sceneVersion = 0;
+	bool valid = false;	//<-- false until recorded, and again after the buffer was reallocated
+};
+
 static void SaveToFile(const std::string& file, const std::string& data)
 {
 	std::ofstream fs;
@@ -1,6 +1,7 @@
 #pragma once
 #include <glm/detail/type_vec2.hpp>
 #include <glm/detail/type_vec3.hpp>
+#include <glm/detail/type_vec4.hpp>
 #include <vulkan/vulkan.hpp>
 
 struct Vertex
@@ -34,4 +35,30 @@ struct Vertex
 
 		return attributeDescriptions;
 	}
+
+	// Per instance model matrix read from binding 1, one mat4 every stride bytes
+	static vk::VertexInputBindingDescription getInstanceBindingDescription(uint32_t stride)
+	{
+		vk::VertexInputBindingDescription binding_description;
+		binding_description.binding = 1;
+		binding_description.stride = stride;
+		binding_description.inputRate = vk::VertexInputRate::eInstance;
+
+		return binding_description;
+	}
+
+	// A mat4 attribute takes one location per column
+	static std::array<vk::VertexInputAttributeDescription, 4> getInstanceAttributeDescriptions()
+	{
+		std::array<vk::VertexInputAttributeDescription, 4> attributeDescriptions = {};
+
+		for (uint32_t column = 0; column < attributeDescriptions.size(); ++column) {
+			attributeDescriptions[column].binding = 1;
+			attributeDescriptions[column].location = 2 + column;
+			attributeDescriptions[column].format = vk::Format::eR32G32B32A32Sfloat;
+			attributeDescriptions[column].offset = column * sizeof(glm::vec4);
+		}
+
+		return attributeDescriptions;
+	}
 };
\ No newline at end of file
@@ -42,18 +42,62 @@ VulkanApplication::VulkanApplication(Scene scene, Window& win)
 
 void VulkanApplication::run()
 {
-	auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
-	m_ThreadPool = new ThreadPool(threadCount);
-	m_QueryResults.resize(threadCount);
+	auto& testConfig = TestConfiguration::GetInstance();
+	auto topology = CpuTopology::Detect();
+	if (testConfig.drawThreadCount == 0) {
+		testConfig.drawThreadCount = topology.defaultThreadCount(testConfig.numaNode);
+	}
+	auto threadCount = testConfig.drawThreadCount;
+
+	//main thread goes on the first cpu of the placement, the draw threads on the rest
+	testConfig.threadCpus = topology.placement(testConfig.threadPlacement, threadCount, testConfig.numaNode);
+	std::vector<unsigned> workerCpus;
+	if (!testConfig.threadCpus.empty()) {
+		CpuTopology::PinCurrentThread(testConfig.threadCpus[0]);
+		workerCpus.assign(testConfig.threadCpus.begin() + 1, testConfig.threadCpus.end());
+	}
+
+	std::cout << "Draw threads: " << threadCount << " (" << topology.physicalCoreCount(testConfig.numaNode) << " physical cores)" << std::endl;
+	for (auto i = 0; i < workerCpus.size(); ++i) {
+		std::cout << "Draw thread " << i << " -> cpu " << workerCpus[i] << std::endl;
+	}
+
+	m_ThreadPool = new ThreadPool(threadCount, workerCpus, testConfig.queueBackend);
+	m_ThreadPool->set_wait_policy(testConfig.waitPolicy, std::chrono::microseconds(testConfig.spinMicroseconds));
+	m_ThreadPool->set_statistics_enabled(testConfig.recordThreadStatistics);
+
+	//every draw thread records recordChunks secondary buffers, each with its own command pools and query
+	if (testConfig.recordChunks == 0) {
+		testConfig.recordChunks = 1;
+	}
+	m_RecordRanges = RangeBalancer(m_Scene.renderObjects().size(), threadCount * testConfig.recordChunks);
+	m_RangeDurations.assign(m_RecordRanges.rangeCount(), 0);
+	m_QueryResults.resize(m_RecordRanges.rangeCount());
+
+	if (testConfig.framesInFlight == 0) {
+		testConfig.framesInFlight = 1;
+	}
+
+	//indirect draws are all issued by the one primary buffer, there are no per range buffers to submit
+	if (testConfig.primaryPerThread && testConfig.indirect) {
+		std::cout << "-primaryPerThread doesn't apply to -indirect and is ignored" << std::endl;
+		testConfig.primaryPerThread = false;
+	}
+	//moving a range boundary invalidates the cached buffers on both sides of it, balancing every frame would re-record nearly all of them
+	if (testConfig.balanceRecording && testConfig.cacheCommandBuffers) {
+		std::cout << "-balance re-records the cached command buffers every frame, it is ignored with -cacheComBuf" << std::endl;
+		testConfig.balanceRecording = false;
+	}
 
 	initVulkan();
+	createFrameGraph();
 #ifdef _DEBUG
-	updateUniformBuffer();
-	updateDynamicUniformBuffer(0);
-	updateDynamicUniformBuffer(1);
-	updateDynamicUniformBuffer(2);
+	//every image's matrices in one go, the same function the matrices nodes run on their ranges
+	for (auto i = 0; i < m_DynamicUniformBuffer.size(); ++i) {
+		updateModelMatrices(modelMatrices(i), 0, m_Scene.renderObjects().size());
+	}
 
-	glm::mat4 model_view = m_UniformBufferObject.view * m_InstanceUniformBufferObject.model[0];
+	glm::mat4 model_view = m_UniformBufferObject.view * *reinterpret_cast<const glm::mat4*>(modelMatrices(0));
 	glm::vec3 model_space = {0.0f, 0.0f, 0.0f};
 	glm::vec3 world_space = model_view * glm::vec4(model_space, 1.0f);
 	glm::vec3 camera_space = m_UniformBufferObject.projection * model_view * glm::vec4(model_space, 1.0f);
@@ -71,18 +115,11 @@ void VulkanApplication::createVertexBuffer()
 	auto buffer_size = sizeof(Vertex)*s_Vertices.size();
 	vk::BufferCreateInfo buffer_create_info = {};
 	buffer_create_info.size = buffer_size;
-	buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferSrc;
-
-	auto buffer = Buffer(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-	
-	memcpy(buffer.map(), s_Vertices.data(), buffer_size);
-	buffer.unmap();
-
 	buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eVertexBuffer;
 
-	m_VertexBuffer = std::make_unique<Buffer>(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	m_VertexBuffer = std::make_unique<Buffer>(*m_Allocator, buffer_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-	copyBuffer(buffer.m_Buffer, m_VertexBuffer->m_Buffer, buffer_size);
+	m_Uploads->uploadBuffer(s_Vertices.data(), buffer_size, m_VertexBuffer->m_Buffer);
 }
 
 void VulkanApplication::createIndexBuffer()
@@ -90,18 +127,11 @@ void VulkanApplication::createIndexBuffer()
 	auto buffer_size = sizeof s_Indices[0]*s_Indices.size();
 	vk::BufferCreateInfo buffer_create_info = {};
 	buffer_create_info.size = buffer_size;
-	buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferSrc;
-
-	auto buffer = Buffer(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
-
-	memcpy(buffer.map(), s_Indices.data(), buffer_size);
-	buffer.unmap();
-
 	buffer_create_info.usage = vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eIndexBuffer;
 
-	m_IndexBuffer =  std::make_unique<Buffer>(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+	m_IndexBuffer =  std::make_unique<Buffer>(*m_Allocator, buffer_create_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-	copyBuffer(buffer.m_Buffer, m_IndexBuffer->m_Buffer, buffer_size);
+	m_Uploads->uploadBuffer(s_Indices.data(), buffer_size, m_IndexBuffer->m_Buffer);
 }
 
 void VulkanApplication::createDescriptorSetLayout()
@@ -144,7 +174,7 @@ void VulkanApplication::createUniformBuffer()
 	vk::BufferCreateInfo buffer_create_info;
 	buffer_create_info.size = buffer_size;
 	buffer_create_info.usage = vk::BufferUsageFlagBits::eUniformBuffer;
-	m_UniformBuffer = std::make_unique<Buffer>(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible|vk::MemoryPropertyFlagBits::eHostCoherent);
+	m_UniformBuffer = std::make_unique<Buffer>(*m_Allocator, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible|vk::MemoryPropertyFlagBits::eHostCoherent);
 
 	auto allignment = properties.limits.minUniformBufferOffsetAlignment;
 	m_DynamicAllignment = sizeof(*m_InstanceUniformBufferObject.model);
@@ -155,73 +185,102 @@ void VulkanApplication::createUniformBuffer()
 	}
 
 	buffer_size = m_Scene.renderObjects().size() * m_DynamicAllignment;
-	m_InstanceUniformBufferObject.model = static_cast<glm::mat4 *>(_aligned_malloc(buffer_size, m_DynamicAllignment));
+	//pushed matrices are read on the cpu while recording, everything else writes straight into the mapped buffers
+	if (TestConfiguration::GetInstance().pushConstants) {
+		m_InstanceUniformBufferObject.model = static_cast<glm::mat4 *>(_aligned_malloc(buffer_size, m_DynamicAllignment));
+	}
 	buffer_create_info.size = buffer_size;
-	// Because no HOST_COHERENT flag we must flush the buffer when writing to it
+	buffer_create_info.usage = vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eVertexBuffer;	//<-- vertex buffer for -instanced
+	// host coherent and mapped for their whole lifetime (see MemoryAllocator), so writes need neither a flush nor a map
 
 	for (auto i = 0; i < m_SwapChainImages.size(); ++i) {
-		m_DynamicUniformBuffer.push_back(std::make_unique<Buffer>(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		m_DynamicUniformBuffer.push_back(std::make_unique<Buffer>(*m_Allocator, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+	}
+}
+
+void VulkanApplication::createIndirectBuffers()
+{
+	if (!TestConfiguration::GetInstance().indirect) {
+		return;
+	}
+
+	vk::BufferCreateInfo buffer_create_info;
+	buffer_create_info.size = m_Scene.renderObjects().size() * sizeof(vk::DrawIndexedIndirectCommand);
+	buffer_create_info.usage = vk::BufferUsageFlagBits::eIndirectBuffer;
+
+	//mapped once and kept mapped, the draw threads write straight into them every frame
+	for (auto i = 0; i < m_SwapChainImages.size(); ++i) {
+		m_IndirectBuffer.push_back(std::make_unique<Buffer>(*m_Allocator, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
+		m_IndirectCommands.push_back(static_cast<vk::DrawIndexedIndirectCommand*>(m_IndirectBuffer.back()->map()));
 	}
 }
 
 void VulkanApplication::createDescriptorPool()
 {
+	//one set per dynamic uniform buffer, so one per swap chain image
+	auto setCount = static_cast<uint32_t>(m_DynamicUniformBuffer.size());
+
 	std::array<vk::DescriptorPoolSize, 3> pool_sizes;
 	pool_sizes[0].type = vk::DescriptorType::eUniformBuffer;
-	pool_sizes[0].descriptorCount = 1;
+	pool_sizes[0].descriptorCount = setCount;
 	pool_sizes[1].type = vk::DescriptorType::eUniformBufferDynamic;
-	pool_sizes[1].descriptorCount = 1;
+	pool_sizes[1].descriptorCount = setCount;
 	pool_sizes[2].type = vk::DescriptorType::eCombinedImageSampler;
-	pool_sizes[2].descriptorCount = 1;
+	pool_sizes[2].descriptorCount = setCount;
 
 	vk::DescriptorPoolCreateInfo pool_info = {};
 	pool_info.poolSizeCount = pool_sizes.size();
 	pool_info.pPoolSizes = pool_sizes.data();
-	pool_info.maxSets = 1; 
+	pool_info.maxSets = setCount; 
 
 	m_DescriptorPool = m_LogicalDevice.createDescriptorPool(pool_info);
 }
 
-void VulkanApplication::createDescriptorSet()
+void VulkanApplication::createDescriptorSets()
 {
+	std::vector<vk::DescriptorSetLayout> layouts(m_DynamicUniformBuffer.size(), m_DescriptorSetLayout);
+
 	vk::DescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.descriptorPool = m_DescriptorPool;
-	allocInfo.descriptorSetCount = 1;
-	allocInfo.pSetLayouts = &m_DescriptorSetLayout;
+	allocInfo.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+	allocInfo.pSetLayouts = layouts.data();
 
-	m_DescriptorSet = m_LogicalDevice.allocateDescriptorSets(allocInfo)[0];
+	m_DescriptorSets = m_LogicalDevice.allocateDescriptorSets(allocInfo);
 
 	vk::DescriptorBufferInfo bufferInfo;
 	bufferInfo.buffer = m_UniformBuffer->m_Buffer;
 	bufferInfo.offset = 0;
 	bufferInfo.range = m_UniformBuffer->size();
 
-	vk::DescriptorBufferInfo dynamicBufferInfo;
-	dynamicBufferInfo.buffer = m_DynamicUniformBuffer[0]->m_Buffer;
-	dynamicBufferInfo.offset = 0;
-	dynamicBufferInfo.range = m_DynamicAllignment;
-
 	vk::DescriptorImageInfo image_info;
 	image_info.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 	image_info.imageView = m_TextureImage->m_ImageView;
 	image_info.sampler = m_TextureSampler;
 
-	std::array<vk::WriteDescriptorSet, 3> descriptorWrites = {
-		vk::WriteDescriptorSet(m_DescriptorSet, 0)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBuffer)
-			.setPBufferInfo(&bufferInfo),
-		vk::WriteDescriptorSet(m_DescriptorSet, 1)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
-			.setPBufferInfo(&dynamicBufferInfo),
-		vk::WriteDescriptorSet(m_DescriptorSet, 2)
-			.setDescriptorCount(1)
-			.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-			.setPImageInfo(&image_info)
-	};
+	//written once here: the sets only differ in binding 1, the dynamic uniform buffer of their swap chain image
+	for (auto i = 0; i < m_DescriptorSets.size(); ++i) {
+		vk::DescriptorBufferInfo dynamicBufferInfo;
+		dynamicBufferInfo.buffer = m_DynamicUniformBuffer[i]->m_Buffer;
+		dynamicBufferInfo.offset = 0;
+		dynamicBufferInfo.range = m_DynamicAllignment;
+
+		std::array<vk::WriteDescriptorSet, 3> descriptorWrites = {
+			vk::WriteDescriptorSet(m_DescriptorSets[i], 0)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eUniformBuffer)
+				.setPBufferInfo(&bufferInfo),
+			vk::WriteDescriptorSet(m_DescriptorSets[i], 1)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+				.setPBufferInfo(&dynamicBufferInfo),
+			vk::WriteDescriptorSet(m_DescriptorSets[i], 2)
+				.setDescriptorCount(1)
+				.setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+				.setPImageInfo(&image_info)
+		};
 
-	m_LogicalDevice.updateDescriptorSets(descriptorWrites, {});
+		m_LogicalDevice.updateDescriptorSets(descriptorWrites, {});
+	}
 }
 
 vk::ImageView VulkanApplication::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspect_flags) const
@@ -307,7 +366,7 @@ void VulkanApplication::createDepthResources()
 	imageCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
 	imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
 
-	m_DepthImage = std::make_unique<Image>(m_LogicalDevice, m_PhysicalDevice, imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eDepth);
+	m_DepthImage = std::make_unique<Image>(*m_Allocator, imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eDepth);
 
 	transitionImageLayout(m_DepthImage->m_Image, m_DepthImage->m_Format, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
 }
@@ -317,7 +376,7 @@ void VulkanApplication::createQueryPool()
 	vk::QueryPoolCreateInfo query_pool_create_info;
 	query_pool_create_info
 		.setQueryType(vk::QueryType::ePipelineStatistics)
-		.setQueryCount(TestConfiguration::GetInstance().drawThreadCount)
+		.setQueryCount(m_RecordRanges.rangeCount())
 		.setPipelineStatistics(
 			vk::QueryPipelineStatisticFlagBits::eClippingInvocations |
 			vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
@@ -332,7 +391,126 @@ void VulkanApplication::createQueryPool()
 			vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations);
 
 	// Throws exception on fail
-	m_QueryPool = m_LogicalDevice.createQueryPool(query_pool_create_info);
+	for (auto i = 0; i < m_SwapChainImages.size(); ++i) {
+		m_QueryPools.push_back(m_LogicalDevice.createQueryPool(query_pool_create_info));
+	}
+	m_PendingFrames.assign(m_SwapChainImages.size(), -1);
+
+	auto& testConfig = TestConfiguration::GetInstance();
+	if (!testConfig.gpuTimestamps) {
+		return;
+	}
+
+	auto validBits = m_PhysicalDevice.getQueueFamilyProperties()[findQueueFamilies(m_PhysicalDevice).graphicsFamily].timestampValidBits;
+	if (validBits == 0) {
+		std::cout << "The graphics queue doesn't support timestamps, -gpuTimestamps is ignored" << std::endl;
+		testConfig.gpuTimestamps = false;
+		return;
+	}
+	m_TimestampMask = validBits < 64 ? (1ull << validBits) - 1 : ~0ull;
+	m_TimestampPeriod = m_PhysicalDevice.getProperties().limits.timestampPeriod;
+
+	auto rangeCount = m_RecordRanges.rangeCount();
+	m_TimestampsPerImage = s_PassTimestamps + 2 * rangeCount;
+
+	vk::QueryPoolCreateInfo timestamp_pool_create_info;
+	timestamp_pool_create_info
+		.setQueryType(vk::QueryType::eTimestamp)
+		.setQueryCount(m_TimestampsPerImage * m_SwapChainImages.size());
+	m_TimestampQueryPool = m_LogicalDevice.createQueryPool(timestamp_pool_create_info);
+
+	m_GpuTimeCsv << "Frame;Image;StartPass(ns);DrawPass(ns);Frame(ns)";
+	for (auto i = 0; i < rangeCount; ++i) {
+		m_GpuTimeCsv << ";Range" << i << "(ns)";
+	}
+	m_GpuTimeCsv << "\n";
+}
+
+void VulkanApplication::readQueries(uint32_t frameIndex)
+{
+	auto frame = m_PendingFrames[frameIndex];
+	if (frame < 0) {
+		return;
+	}
+
+	readTimestamps(frameIndex, frame);
+	readPipelineStatistics(frameIndex, frame);
+	m_PendingFrames[frameIndex] = -1;
+}
+
+void VulkanApplication::readPipelineStatistics(uint32_t frameIndex, int64_t frame)
+{
+	if (!TestConfiguration::GetInstance().pipelineStatistics) {
+		return;
+	}
+
+	//no eWait, the frame's fence has signaled, so the results are there and reading them doesn't stall
+	auto rangeCount = m_RecordRanges.rangeCount();
+	auto result = m_LogicalDevice.getQueryPoolResults(
+		m_QueryPools[frameIndex],
+		0,
+		rangeCount,
+		sizeof(PipelineStatisticsResult) * rangeCount,
+		m_QueryResults.data(),
+		sizeof uint64_t,
+		vk::QueryResultFlagBits::e64);
+	if (result == vk::Result::eNotReady) {
+		return;
+	}
+	if (result != vk::Result::eSuccess) {
+		throw std::runtime_error("Failed get the query results from the logical device");
+	}
+
+	for (auto i = 0; i < rangeCount; ++i) {
+		auto& queryResult = m_QueryResults[i];
+		PipelineStatisticsDataItem item;
+		item.CInvocations = std::to_string(queryResult.clippingInvocations);
+		item.CommandListId = std::to_string(i);
+		item.CPrimitives = std::to_string(queryResult.clippingPrimitives);
+		item.CSInvocations = std::to_string(queryResult.computeShaderInvocations);
+		item.DSInvocations = "N/A";
+		item.GSInvocations = std::to_string(queryResult.geometryShaderInvocations);
+		item.GSPrimitives = std::to_string(queryResult.geometryShaderPrimitives);
+		item.HSInvocations = "N/A";
+		item.IAPrimitives = std::to_string(queryResult.inputAssemblyPrimitives);
+		item.IAVertices = std::to_string(queryResult.inputAssemblyVertices);
+		item.PSInvocations = std::to_string(queryResult.fragmentShaderInvocations);
+		item.VSInvocations = std::to_string(queryResult.vertexShaderInvocations);
+		item.Frame = std::to_string(frame);
+
+		pipelineStatisticsCollection.Add(item);
+	}
+}
+
+void VulkanApplication::readTimestamps(uint32_t frameIndex, int64_t frame)
+{
+	if (!TestConfiguration::GetInstance().gpuTimestamps) {
+		return;
+	}
+
+	//no eWait, the caller has waited for the frame's fence. Not ready means the frame was never submitted
+	std::vector<uint64_t> timestamps(m_TimestampsPerImage);
+	auto result = m_LogicalDevice.getQueryPoolResults(
+		m_TimestampQueryPool,
+		firstTimestamp(frameIndex),
+		m_TimestampsPerImage,
+		sizeof(uint64_t) * timestamps.size(),
+		timestamps.data(),
+		sizeof(uint64_t),
+		vk::QueryResultFlagBits::e64);
+	if (result != vk::Result::eSuccess) {
+		return;
+	}
+
+	auto nanoseconds = [&](size_t begin, size_t end) {
+		return static_cast<uint64_t>(((timestamps[end] - timestamps[begin]) & m_TimestampMask) * m_TimestampPeriod);
+	};
+
+	m_GpuTimeCsv << frame << ";" << frameIndex << ";" << nanoseconds(0, 1) << ";" << nanoseconds(2, 3) << ";" << nanoseconds(0, 3);
+	for (auto i = s_PassTimestamps; i < m_TimestampsPerImage; i += 2) {
+		m_GpuTimeCsv << ";" << nanoseconds(i, i + 1);
+	}
+	m_GpuTimeCsv << "\n";
 }
 
 // Initializes Vulkan
@@ -340,10 +518,15 @@ void VulkanApplication::initVulkan() {
 	createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
+	m_Allocator = std::make_unique<MemoryAllocator>(m_PhysicalDevice, m_LogicalDevice);	//<-- every Buffer and Image takes its memory from here
+	m_Uploads = std::make_unique<UploadManager>(*m_Allocator, m_GraphicsQueue, findQueueFamilies(m_PhysicalDevice).graphicsFamily);
 	createSwapChain();
 	createImageViews();
 	createRenderPass();
 	createDescriptorSetLayout();
+	createUniformBuffer();	//<-- before the pipeline, -instanced uses the dynamic allignment as vertex stride
+	updateUniformBuffer();
+	createIndirectBuffers();
 	createGraphicsPipeline();
 	createCommandPool();
 	createDepthResources();
@@ -352,34 +535,46 @@ void VulkanApplication::initVulkan() {
 	createTextureSampler();
 	createVertexBuffer();
 	createIndexBuffer();
-	createUniformBuffer();
 	createDescriptorPool();
-	createDescriptorSet();
+	createDescriptorSets();
 	createQueryPool();
 	createCommandBuffer();
-	createSemaphores();
+	createSyncObjects();
+
+	//the buffer, texture and depth uploads above were only recorded, they all go to the GPU in one submission here
+	m_Uploads->flush();
 }
 
-void VulkanApplication::createSemaphores() {
+void VulkanApplication::createSyncObjects() {
 	vk::SemaphoreCreateInfo semaphoreInfo = {};
 
-	m_ImageAvaliableSemaphore = m_LogicalDevice.createSemaphore(semaphoreInfo);
-	m_RenderFinishedSemaphore = m_LogicalDevice.createSemaphore(semaphoreInfo);
+	//signaled, so waiting for a frame that was never submitted doesn't block
+	vk::FenceCreateInfo fenceInfo = {};
+	fenceInfo.flags = vk::FenceCreateFlagBits::eSignaled;
+
+	for (auto i = 0; i < TestConfiguration::GetInstance().framesInFlight; ++i) {
+		m_ImageAvaliableSemaphores.push_back(m_LogicalDevice.createSemaphore(semaphoreInfo));
+		m_RenderFinishedSemaphores.push_back(m_LogicalDevice.createSemaphore(semaphoreInfo));
+		m_InFlightFences.push_back(m_LogicalDevice.createFence(fenceInfo));
+	}
 }
 
  void VulkanApplication::createCommandBuffer() {
-	 auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
+	 auto rangeCount = m_RecordRanges.rangeCount();
 	 auto frameBufferCount = m_SwapChainFramebuffers.size();
-	 //one command buffer per frame buffer per thread:
-	m_DrawCommandBuffers.resize(frameBufferCount * threadCount);
+	 //one command buffer per frame buffer per range:
+	m_DrawCommandBuffers.resize(frameBufferCount * rangeCount);
 	m_StartCommandBuffers.resize(frameBufferCount);
 	//allocate room for buffers in command pool:
 
 	vk::CommandBufferAllocateInfo allocInfo = {};
 	allocInfo.level = vk::CommandBufferLevel::eSecondary; //buffers can be primary (called to by user) or secondary (called to by primary buffer)
+	if (TestConfiguration::GetInstance().primaryPerThread) {
+		allocInfo.level = vk::CommandBufferLevel::ePrimary;
+	}
 	allocInfo.commandBufferCount = 1;
 	
-	for(int i = 0; i < threadCount * frameBufferCount; ++i)
+	for(int i = 0; i < rangeCount * frameBufferCount; ++i)
 	{
 		allocInfo.commandPool = m_CommandPool[i];
 
@@ -388,6 +583,9 @@ void VulkanApplication::createSemaphores() {
 		m_DrawCommandBuffers[i] = cmdBufVec[0];
 	}
 
+	//new buffers are empty, so nothing can be taken from the cache
+	m_RecordedRanges.assign(rangeCount * frameBufferCount, RecordedRange());
+
 	vk::CommandBufferAllocateInfo startAllocInfo = {};
 	startAllocInfo.commandPool = m_StartCommandPool;
 	startAllocInfo.level = vk::CommandBufferLevel::ePrimary;
@@ -401,6 +599,121 @@ void VulkanApplication::createSemaphores() {
 }
 
  void VulkanApplication::recordCommandBuffers(uint32_t frameIndex) {
+	 prepareDrawRenderObjectsInfos(frameIndex);
+
+	 //pushed matrices end up in the command buffers, so they have to exist before recording
+	 if (m_PushConstants) {
+		 updateModelMatrices(modelMatrices(frameIndex), 0, m_Scene.renderObjects().size());
+	 }
+
+	 //every draw thread records its own range, then pulls the remaining chunks
+	 TaskCounter recorded;
+	 for (auto i = 0; i < m_ThreadPool->thread_count(); ++i) {
+		 m_ThreadPool->submit_to(recordingThread(i), recorded, [this, i] { recordRanges(i); });
+	 }
+	 m_ThreadPool->wait(recorded);
+
+	 recordPrimaryCommandBuffer(frameIndex);
+ }
+
+ void VulkanApplication::recordRange(size_t rangeIndex) {
+	 auto& info = m_DrawRenderObjectsInfos[rangeIndex];
+	 auto& recorded = m_RecordedRanges[info.frameIndex * m_RecordRanges.rangeCount() + rangeIndex];
+	 auto range = objectRange(rangeIndex);
+	 auto sceneVersion = m_Scene.version();
+
+	 //pushed matrices are part of the commands, so those buffers are stale every frame
+	 if (TestConfiguration::GetInstance().cacheCommandBuffers && !m_PushConstants && recorded.valid &&
+		 recorded.first == range.first && recorded.last == range.second &&
+		 !m_Scene.changedSince(range.first, range.second, recorded.sceneVersion))
+	 {
+		 //m_RangeDurations keeps the time of the last recording, so balancing still sees the real cost
+		 return;
+	 }
+
+	 auto start = std::chrono::steady_clock::now();
+
+	 if (TestConfiguration::GetInstance().indirect) {
+		 WriteIndirectCommands(info);
+	 }
+	 else {
+		 DrawRenderObjects(info);
+	 }
+
+	 m_RangeDurations[rangeIndex] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	 recorded.first = range.first;
+	 recorded.last = range.second;
+	 recorded.sceneVersion = sceneVersion;
+	 recorded.valid = true;
+	 ++m_RerecordCount;
+ }
+
+ void VulkanApplication::recordRanges(size_t worker) {
+	 //range i < thread count always goes to worker i, so without chunks every pool is only used by one thread
+	 recordRange(worker);
+
+	 //the other chunks go to whichever thread is done first. Their pools change threads between frames,
+	 //which is fine since one frame's recording has finished before the next one starts
+	 auto rangeCount = m_RecordRanges.rangeCount();
+	 for (auto i = m_NextRange++; i < rangeCount; i = m_NextRange++) {
+		 recordRange(i);
+	 }
+ }
+
+ size_t VulkanApplication::recordingThread(size_t rangeIndex) const {
+	 //fixed mapping, so the command pools of a range (m_CommandPool[frameIndex * rangeCount + rangeIndex]) are only ever used by one thread
+	 return rangeIndex % m_ThreadPool->thread_count();
+ }
+
+ std::pair<size_t, size_t> VulkanApplication::objectRange(size_t rangeIndex) const {
+	 return m_RecordRanges.range(rangeIndex);
+ }
+
+ void VulkanApplication::prepareDrawRenderObjectsInfos(uint32_t frameIndex) {
+	 auto rangeCount = m_RecordRanges.rangeCount();
+	 m_NextRange = m_ThreadPool->thread_count();
+	 m_RerecordCount = 0;
+	 m_DrawRenderObjectsInfos.resize(rangeCount);
+	 for (auto i = 0; i < rangeCount; ++i) {
+		 auto& drawROInfo = m_DrawRenderObjectsInfos[i];
+		 drawROInfo = {};
+
+		 auto& command_buffer = m_DrawCommandBuffers[frameIndex * rangeCount + i];
+		 auto range = objectRange(i);
+		 drawROInfo.firstObject = range.first;
+
+		 drawROInfo.commandBuffer = &command_buffer;
+		 drawROInfo.descriptorSet = &m_DescriptorSets[frameIndex];
+		 drawROInfo.dynamicAllignment = m_DynamicAllignment;
+		 drawROInfo.numOfIndices = s_Indices.size();
+		 drawROInfo.pipelineLayout = &m_PipelineLayout;
+		 drawROInfo.roArr = m_Scene.renderObjects().data() + range.first;	//<-- ranges can be empty, so no operator[] here
+		 drawROInfo.roArrCount = range.second - range.first;
+		 drawROInfo.frameIndex = frameIndex;
+		 drawROInfo.queryPool = &m_QueryPools[frameIndex];
+		 drawROInfo.timestampQueryPool = TestConfiguration::GetInstance().gpuTimestamps ? &m_TimestampQueryPool : nullptr;
+		 drawROInfo.firstTimestamp = firstTimestamp(frameIndex) + s_PassTimestamps + 2 * i;
+		 drawROInfo.threadId = i;
+		 drawROInfo.renderPass = &m_RenderPass;
+		 if (TestConfiguration::GetInstance().primaryPerThread) {
+			 drawROInfo.renderPass = &m_LoadRenderPass;
+			 drawROInfo.ownRenderPass = true;
+			 drawROInfo.renderArea = m_SwapChainExtent;
+			 drawROInfo.endsDrawPass = i == rangeCount - 1;
+			 drawROInfo.drawPassEndTimestamp = firstTimestamp(frameIndex) + 3;
+		 }
+		 drawROInfo.pipeline = &m_GraphicsPipeline;
+		 drawROInfo.vertexBuffer = &m_VertexBuffer->m_Buffer;
+		 drawROInfo.indexBuffer = &m_IndexBuffer->m_Buffer;
+		 drawROInfo.instanceBuffer = &m_DynamicUniformBuffer[frameIndex]->m_Buffer;
+		 drawROInfo.indirectCommands = m_IndirectCommands.empty() ? nullptr : m_IndirectCommands[frameIndex] + range.first;
+		 drawROInfo.modelMatrices = m_PushConstants ? reinterpret_cast<const glm::mat4*>(modelMatrices(frameIndex) + range.first * m_DynamicAllignment) : nullptr;
+		 drawROInfo.framebuffer = &m_SwapChainFramebuffers[frameIndex];
+		 drawROInfo.dynamicUniformBufferStride = m_DynamicAllignment * m_Scene.renderObjects().size();
+	 }
+ }
+
+ void VulkanApplication::recordPrimaryCommandBuffer(uint32_t frameIndex) {
 
 	 //starting render pass:
 	 vk::RenderPassBeginInfo startRenderPassInfo = {};
@@ -433,70 +746,102 @@ void VulkanApplication::createSemaphores() {
 	 vk::CommandBufferBeginInfo beginInfo = {};
 	 beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 
-	 /***********************************************************************************/
-	 //Thread recording of draw commands:
-	 auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
-	 std::vector<std::future<void>> futures;
-	 for (auto i = 0; i < threadCount; ++i) {
-		 DrawRenderObjectsInfo drawROInfo = {};
-
-		 auto& command_buffer = m_DrawCommandBuffers[frameIndex * threadCount + i];
-		 auto roCount = m_Scene.renderObjects().size() / threadCount;
-		 auto stride = roCount;
-		 drawROInfo.roArrStride = stride;
-
-		 //last thread handles the remainder after integer division
-		 if (i == threadCount - 1) {
-			 roCount += m_Scene.renderObjects().size() % threadCount;
-		 }
-
-		 drawROInfo.commandBuffer = &command_buffer;
-		 drawROInfo.descriptorSet = &m_DescriptorSet;
-		 drawROInfo.dynamicAllignment = m_DynamicAllignment;
-		 drawROInfo.numOfIndices = s_Indices.size();
-		 drawROInfo.pipelineLayout = &m_PipelineLayout;
-		 drawROInfo.roArr = &m_Scene.renderObjects()[i * stride];
-		 drawROInfo.roArrCount = roCount;
-		 drawROInfo.frameIndex = frameIndex;
-		 drawROInfo.queryPool = &m_QueryPool;
-		 drawROInfo.threadId = i;
-		 drawROInfo.renderPass = &m_RenderPass;
-		 drawROInfo.renderPassBeginInfo = &drawRenderPassInfo;
-		 drawROInfo.pipeline = &m_GraphicsPipeline;
-		 drawROInfo.vertexBuffer = &m_VertexBuffer->m_Buffer;
-		 drawROInfo.indexBuffer = &m_IndexBuffer->m_Buffer;
-		 drawROInfo.framebuffer = &m_SwapChainFramebuffers[frameIndex];
-		 drawROInfo.dynamicUniformBufferStride = m_DynamicAllignment * m_Scene.renderObjects().size();
-
-		 futures.push_back(m_ThreadPool->enqueue(DrawRenderObjects, drawROInfo));
-	 }
-	 /***********************************************************************************/
+	 auto rangeCount = m_RecordRanges.rangeCount();
 
 	 //record setup:	 
 	 auto& startCommandBuffer = m_StartCommandBuffers[frameIndex];
 	 startCommandBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources  );
 	 startCommandBuffer.begin(beginInfo);
-	 startCommandBuffer.beginRenderPass(startRenderPassInfo, vk::SubpassContents::eInline);
-	 
-	 startCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
+
+	 //timestamps must be reset outside of a render pass, this resets the ones of the secondary buffers too
+	 auto timestamps = TestConfiguration::GetInstance().gpuTimestamps;
+	 auto timestampBase = firstTimestamp(frameIndex);
+	 if (timestamps) {
+		 startCommandBuffer.resetQueryPool(m_TimestampQueryPool, timestampBase, m_TimestampsPerImage);
+		 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_TimestampQueryPool, timestampBase);
+	 }
+	 if (TestConfiguration::GetInstance().pipelineStatistics) {
+		 startCommandBuffer.resetQueryPool(m_QueryPools[frameIndex], 0, rangeCount);
+	 }
+
+	 //the start pass clears to red and draws nothing, and its binds don't carry over into the next pass.
+	 //Without it the draw pass is the only clear and store of the frame
+	 if (!TestConfiguration::GetInstance().singleRenderPass) {
+		 startCommandBuffer.beginRenderPass(startRenderPassInfo, vk::SubpassContents::eInline);
 	 
-	 startCommandBuffer.bindVertexBuffers(
-		 0,								// index of first buffer
-		 { m_VertexBuffer->m_Buffer },	// Array of buffers
-		 { 0 });							// Array of offsets into the buffers
-	 startCommandBuffer.bindIndexBuffer(m_IndexBuffer->m_Buffer, 0, vk::IndexType::eUint16);
+		 startCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
 	 
-	 startCommandBuffer.endRenderPass();
-	 startCommandBuffer.beginRenderPass(drawRenderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		 startCommandBuffer.bindVertexBuffers(
+			 0,								// index of first buffer
+			 { m_VertexBuffer->m_Buffer },	// Array of buffers
+			 { 0 });							// Array of offsets into the buffers
+		 startCommandBuffer.bindIndexBuffer(m_IndexBuffer->m_Buffer, 0, vk::IndexType::eUint16);
 	 
-	 //wait for all recordings to finish
-	 for (auto& future : futures) {
-		 future.wait();
+		 startCommandBuffer.endRenderPass();
 	 }
 
-	 startCommandBuffer.executeCommands(threadCount, &m_DrawCommandBuffers[frameIndex * threadCount]);
+	 //with -singlePass the start pass takes no time
+	 if (timestamps) {
+		 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampQueryPool, timestampBase + 1);
+		 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_TimestampQueryPool, timestampBase + 2);
+	 }
+
+	 if (TestConfiguration::GetInstance().indirect) {
+		 //the draw threads only wrote the commands, everything else is bound here
+		 startCommandBuffer.beginRenderPass(drawRenderPassInfo, vk::SubpassContents::eInline);
+		 startCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, m_GraphicsPipeline);
+		 startCommandBuffer.bindVertexBuffers(0, { m_VertexBuffer->m_Buffer, m_DynamicUniformBuffer[frameIndex]->m_Buffer }, { 0, 0 });
+		 startCommandBuffer.bindIndexBuffer(m_IndexBuffer->m_Buffer, 0, vk::IndexType::eUint16);
+		 startCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_PipelineLayout, 0, { m_DescriptorSets[frameIndex] }, { 0 });
+
+		 //one indirect draw per range, so the pipeline statistics stay per range
+		 const auto stride = static_cast<uint32_t>(sizeof(vk::DrawIndexedIndirectCommand));
+		 for (auto i = 0; i < rangeCount; ++i) {
+			 auto range = objectRange(i);
+			 auto count = static_cast<uint32_t>(range.second - range.first);
+
+			 if (timestamps) {
+				 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, m_TimestampQueryPool, timestampBase + s_PassTimestamps + 2 * i);
+			 }
+
+			 if (TestConfiguration::GetInstance().pipelineStatistics) {
+				 startCommandBuffer.beginQuery(m_QueryPools[frameIndex], i, vk::QueryControlFlags());
+			 }
+
+			 if (m_MultiDrawIndirect) {
+				 startCommandBuffer.drawIndexedIndirect(m_IndirectBuffer[frameIndex]->m_Buffer, range.first * stride, count, stride);
+			 }
+			 else {
+				 for (auto j = range.first; j < range.second; ++j) {
+					 startCommandBuffer.drawIndexedIndirect(m_IndirectBuffer[frameIndex]->m_Buffer, j * stride, 1, stride);
+				 }
+			 }
+
+			 if (TestConfiguration::GetInstance().pipelineStatistics) {
+				 startCommandBuffer.endQuery(m_QueryPools[frameIndex], i);
+			 }
+
+			 if (timestamps) {
+				 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampQueryPool, timestampBase + s_PassTimestamps + 2 * i + 1);
+			 }
+		 }
+	 }
+	 else if (TestConfiguration::GetInstance().primaryPerThread) {
+		 //only the clear, the ranges are drawn by their own primary buffers, submitted after this one
+		 startCommandBuffer.beginRenderPass(drawRenderPassInfo, vk::SubpassContents::eInline);
+	 }
+	 else {
+		 startCommandBuffer.beginRenderPass(drawRenderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		 startCommandBuffer.executeCommands(rangeCount, &m_DrawCommandBuffers[frameIndex * rangeCount]);
+	 }
 
 	 startCommandBuffer.endRenderPass();
+
+	 //with -primaryPerThread the draw pass ends in the buffer of the last range
+	 if (timestamps && !TestConfiguration::GetInstance().primaryPerThread) {
+		 startCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, m_TimestampQueryPool, timestampBase + 3);
+	 }
+
 	 startCommandBuffer.end();
  }
 
@@ -522,10 +867,23 @@ void VulkanApplication::createSemaphores() {
 	 vk::CommandBufferBeginInfo beginInfo = {};
 	 beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
 	 beginInfo.pInheritanceInfo = &inheritInfo;
+	 if (info.ownRenderPass) {
+		 beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+		 beginInfo.pInheritanceInfo = nullptr;
+	 }
 
 	 info.commandBuffer->reset(vk::CommandBufferResetFlagBits::eReleaseResources);
 	 info.commandBuffer->begin(beginInfo);
 
+	 if (info.ownRenderPass) {
+		 vk::RenderPassBeginInfo renderPassInfo = {};
+		 renderPassInfo.renderPass = *info.renderPass;
+		 renderPassInfo.framebuffer = *info.framebuffer;
+		 renderPassInfo.renderArea.offset = vk::Offset2D{ 0,0 };
+		 renderPassInfo.renderArea.extent = info.renderArea;
+		 info.commandBuffer->beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+	 }
+
 	 info.commandBuffer->bindPipeline(vk::PipelineBindPoint::eGraphics, *info.pipeline);
 	 
 	 info.commandBuffer->bindVertexBuffers(
@@ -535,24 +893,72 @@ void VulkanApplication::createSemaphores() {
 	 
 	 info.commandBuffer->bindIndexBuffer(*info.indexBuffer, 0, vk::IndexType::eUint16);
 
+	 if (info.timestampQueryPool) {
+		 info.commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *info.timestampQueryPool, info.firstTimestamp);
+	 }
+
 	 if (TestConfiguration::GetInstance().pipelineStatistics) {
 
 		info.commandBuffer->beginQuery(*info.queryPool, info.threadId, vk::QueryControlFlags());
 	 }
 
-	 for (int j = 0; j < info.roArrCount; ++j) {
-		 uint32_t dynamic_offset = info.threadId * info.roArrStride * info.dynamicAllignment + j * info.dynamicAllignment;
-		 info.commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *info.pipelineLayout, 0, { *info.descriptorSet }, { dynamic_offset });
-		 info.commandBuffer->drawIndexed(info.numOfIndices, 1, 0, 0, 0);
+	 if (TestConfiguration::GetInstance().instanced) {
+		 //one draw for the whole range, the instances of this range start at its first render object
+		 uint32_t first_instance = info.firstObject;
+		 info.commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *info.pipelineLayout, 0, { *info.descriptorSet }, { 0 });
+		 info.commandBuffer->bindVertexBuffers(1, { *info.instanceBuffer }, { 0 });
+		 info.commandBuffer->drawIndexed(info.numOfIndices, info.roArrCount, 0, 0, first_instance);
+	 }
+	 else if (TestConfiguration::GetInstance().pushConstants) {
+		 //the dynamic offset is fixed, only the pushed matrix changes between draws
+		 info.commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *info.pipelineLayout, 0, { *info.descriptorSet }, { 0 });
+		 auto model = reinterpret_cast<const uint8_t*>(info.modelMatrices);
+		 for (int j = 0; j < info.roArrCount; ++j) {
+			 info.commandBuffer->pushConstants(*info.pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4), model + j * info.dynamicAllignment);
+			 info.commandBuffer->drawIndexed(info.numOfIndices, 1, 0, 0, 0);
+		 }
+	 }
+	 else {
+		 for (int j = 0; j < info.roArrCount; ++j) {
+			 uint32_t dynamic_offset = (info.firstObject + j) * info.dynamicAllignment;
+			 info.commandBuffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *info.pipelineLayout, 0, { *info.descriptorSet }, { dynamic_offset });
+			 info.commandBuffer->drawIndexed(info.numOfIndices, 1, 0, 0, 0);
+		 }
 	 }
 
 	 if (TestConfiguration::GetInstance().pipelineStatistics) {
 		 info.commandBuffer->endQuery(*info.queryPool, info.threadId);
 	 }
+
+	 if (info.timestampQueryPool) {
+		 info.commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *info.timestampQueryPool, info.firstTimestamp + 1);
+	 }
+
+	 if (info.ownRenderPass) {
+		 info.commandBuffer->endRenderPass();
+
+		 if (info.timestampQueryPool && info.endsDrawPass) {
+			 info.commandBuffer->writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *info.timestampQueryPool, info.drawPassEndTimestamp);
+		 }
+	 }
 	
 	 info.commandBuffer->end();
  }
 
+ void VulkanApplication::WriteIndirectCommands(DrawRenderObjectsInfo& info)
+ {
+	 //plain writes to mapped memory, instance i of the whole scene picks model matrix i
+	 uint32_t first_instance = info.firstObject;
+	 for (uint32_t j = 0; j < info.roArrCount; ++j) {
+		 auto& command = info.indirectCommands[j];
+		 command.indexCount = info.numOfIndices;
+		 command.instanceCount = 1;
+		 command.firstIndex = 0;
+		 command.vertexOffset = 0;
+		 command.firstInstance = first_instance + j;
+	 }
+ }
+
  void VulkanApplication::createCommandPool() {
 	auto frameBufferCount = m_SwapChainImages.size();
 	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(m_PhysicalDevice);
@@ -567,15 +973,12 @@ void VulkanApplication::createSemaphores() {
 		poolInfo.flags =vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 	}
 
-	auto bufferCount = TestConfiguration::GetInstance().drawThreadCount * frameBufferCount;
+	auto bufferCount = m_RecordRanges.rangeCount() * frameBufferCount;
 	for (auto i = 0; i < bufferCount; ++i) {
 		m_CommandPool.push_back(m_LogicalDevice.createCommandPool(poolInfo));
 	}
 
 	m_StartCommandPool = m_LogicalDevice.createCommandPool(poolInfo);
-
-	poolInfo.flags = vk::CommandPoolCreateFlags();
-	m_SingleTimeCommandPool = m_LogicalDevice.createCommandPool(poolInfo);
 }
 
  void VulkanApplication::createFramebuffers() {
@@ -618,7 +1021,7 @@ void VulkanApplication::createSemaphores() {
 	vk::AttachmentDescription depthAttatchment;
 	depthAttatchment.setFormat(findDepthFormat())
 		.setLoadOp(vk::AttachmentLoadOp::eClear) // Clear buffer data at load
-		.setStoreOp(vk::AttachmentStoreOp::eDontCare)
+		.setStoreOp(TestConfiguration::GetInstance().primaryPerThread ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare)	//<-- later passes of the frame test against it
 		.setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
 		.setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
 		.setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
@@ -631,12 +1034,14 @@ void VulkanApplication::createSemaphores() {
 		.setPColorAttachments(&colorAttatchmentRef)
 		.setPDepthStencilAttachment(&depthAttatchmentRef);
 
-	// Handling subpass dependencies
+	// Handling subpass dependencies. There is one depth image for all frames in flight, so the clear of a frame
+	// has to wait for the depth writes of the frame before it, like the color writes wait for the acquire
 	vk::SubpassDependency dependency(VK_SUBPASS_EXTERNAL);
-	dependency.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-		.setSrcAccessMask(vk::AccessFlags())
-		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
+	dependency.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+		.setSrcAccessMask(vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests)
+		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
 
 	std::array<vk::AttachmentDescription, 2> attachments = { colorAttatchment, depthAttatchment };
 
@@ -649,12 +1054,43 @@ void VulkanApplication::createSemaphores() {
 		.setPDependencies(&dependency);
 
 	m_RenderPass = m_LogicalDevice.createRenderPass(renderPassInfo);
+
+	if (!TestConfiguration::GetInstance().primaryPerThread) {
+		return;
+	}
+
+	//same attachments, but they keep what the earlier passes of the frame drew. Compatible with m_RenderPass,
+	//so the framebuffers and the pipeline work with both
+	colorAttatchment.setLoadOp(vk::AttachmentLoadOp::eLoad)
+		.setInitialLayout(vk::ImageLayout::ePresentSrcKHR);
+	depthAttatchment.setLoadOp(vk::AttachmentLoadOp::eLoad)
+		.setInitialLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal);
+	std::array<vk::AttachmentDescription, 2> loadAttachments = { colorAttatchment, depthAttatchment };
+
+	//the previous pass, recorded in another command buffer, has to be done writing the attachments
+	vk::SubpassDependency loadDependency(VK_SUBPASS_EXTERNAL);
+	loadDependency.setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eLateFragmentTests)
+		.setSrcAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite)
+		.setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput | vk::PipelineStageFlagBits::eEarlyFragmentTests)
+		.setDstAccessMask(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite |
+			vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+
+	renderPassInfo.setPAttachments(loadAttachments.data())
+		.setPDependencies(&loadDependency);
+
+	m_LoadRenderPass = m_LogicalDevice.createRenderPass(renderPassInfo);
 }
 
  void VulkanApplication::createGraphicsPipeline() {
 
-	//get byte code of shaders
-	auto vertShader = Shader(m_LogicalDevice, "./shaders/vert.spv", vk::ShaderStageFlagBits::eVertex);
+	//indirect commands draw one instance per render object, so they take the model matrix the same way
+	auto instanced = TestConfiguration::GetInstance().instanced || TestConfiguration::GetInstance().indirect;
+
+	//get byte code of shaders. The instanced variant takes the model matrix as vertex input instead of a dynamic uniform,
+	//the push constant variant as push constant. Push constants only apply to the per object draws.
+	m_PushConstants = TestConfiguration::GetInstance().pushConstants && !instanced;
+	auto vertShaderFile = instanced ? "./shaders/instanced.spv" : m_PushConstants ? "./shaders/pushconstant.spv" : "./shaders/vert.spv";
+	auto vertShader = Shader(m_LogicalDevice, vertShaderFile, vk::ShaderStageFlagBits::eVertex);
 
 
 #ifdef TEST_USE_CUBE
@@ -667,13 +1103,21 @@ void VulkanApplication::createSemaphores() {
 	//for later reference:
 	vk::PipelineShaderStageCreateInfo shaderStages[] = { vertShader.m_Info, fragShader.m_Info };
 
-	auto bindingDescription = Vertex::getBindingDescription();
-	auto attribute_descriptions = Vertex::getAttributeDescriptions();
+	std::vector<vk::VertexInputBindingDescription> binding_descriptions = { Vertex::getBindingDescription() };
+	auto vertex_attributes = Vertex::getAttributeDescriptions();
+	std::vector<vk::VertexInputAttributeDescription> attribute_descriptions(vertex_attributes.begin(), vertex_attributes.end());
+
+	if (instanced) {
+		//the matrices are read straight from the dynamic uniform buffer, so the stride is its allignment
+		binding_descriptions.push_back(Vertex::getInstanceBindingDescription(m_DynamicAllignment));
+		auto instance_attributes = Vertex::getInstanceAttributeDescriptions();
+		attribute_descriptions.insert(attribute_descriptions.end(), instance_attributes.begin(), instance_attributes.end());
+	}
 
 	// Information on how to read from vertex buffer
 	vk::PipelineVertexInputStateCreateInfo vertexInputInfo;
-	vertexInputInfo.setVertexBindingDescriptionCount(1)
-		.setPVertexBindingDescriptions(&bindingDescription)
+	vertexInputInfo.setVertexBindingDescriptionCount(binding_descriptions.size())
+		.setPVertexBindingDescriptions(binding_descriptions.data())
 		.setVertexAttributeDescriptionCount(attribute_descriptions.size())
 		.setPVertexAttributeDescriptions(attribute_descriptions.data());
 
@@ -717,10 +1161,17 @@ void VulkanApplication::createSemaphores() {
 		.setPAttachments(&colorBlendAttatchment);
 
 	 // For uniforms
+	vk::PushConstantRange pushConstantRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::mat4));
+
 	vk::PipelineLayoutCreateInfo pipelineLayoutInfo;
 	pipelineLayoutInfo.setSetLayoutCount(1)
 		.setPSetLayouts(&m_DescriptorSetLayout);
 
+	if (m_PushConstants) {
+		pipelineLayoutInfo.setPushConstantRangeCount(1)
+			.setPPushConstantRanges(&pushConstantRange);
+	}
+
 	m_PipelineLayout = m_LogicalDevice.createPipelineLayout(pipelineLayoutInfo);
 
 	vk::PipelineDepthStencilStateCreateInfo depth_stencil_info;
@@ -761,7 +1212,8 @@ void VulkanApplication::createSemaphores() {
 	vk::PresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentmodes);
 	m_SwapChainExtent = chooseSwapExtend(swapChainSupport.capabilities);
 
-	uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+	//the per image resources are what the frames in flight use, so there have to be enough images to go around
+	uint32_t imageCount = std::max<uint32_t>(swapChainSupport.capabilities.minImageCount + 1, TestConfiguration::GetInstance().framesInFlight);
 	if (swapChainSupport.capabilities.maxImageCount > 0 &&
 		imageCount > swapChainSupport.capabilities.maxImageCount) {
 		imageCount = swapChainSupport.capabilities.maxImageCount;
@@ -801,6 +1253,7 @@ void VulkanApplication::createSemaphores() {
 
 
 	m_SwapChainImages = m_LogicalDevice.getSwapchainImagesKHR(m_SwapChain);
+	m_ImagesInFlight.assign(m_SwapChainImages.size(), vk::Fence());
 
 	
 	m_SwapChainImageFormat = surfaceFormat.format;
@@ -842,6 +1295,19 @@ void VulkanApplication::createSemaphores() {
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.pipelineStatisticsQuery = VK_TRUE;
 
+	//optional, -indirect falls back to one draw call per command without it
+	auto supportedFeatures = m_PhysicalDevice.getFeatures();
+	m_MultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	deviceFeatures.multiDrawIndirect = m_MultiDrawIndirect;
+
+	//-indirect selects the model matrix of a command through firstInstance
+	if (TestConfiguration::GetInstance().indirect) {
+		if (!supportedFeatures.drawIndirectFirstInstance) {
+			throw std::runtime_error("-indirect needs the drawIndirectFirstInstance feature");
+		}
+		deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+	}
+
 												  // Creating VkDeviceCreateInfo object
 	vk::DeviceCreateInfo createInfo = {};
 	createInfo.queueCreateInfoCount = queueCreateInfos.size();
@@ -1035,42 +1501,83 @@ void VulkanApplication::updateUniformBuffer()
 	m_UniformBuffer->unmap();
 }
 
-void VulkanApplication::updateDynamicUniformBuffer(int frameIndex) const
+uint8_t* VulkanApplication::modelMatrices(uint32_t frameIndex) const
 {
-	for (auto index = 0; index < m_Scene.renderObjects().size(); index++)
-	{
-		auto& render_object = m_Scene.renderObjects()[index];
-		auto model = reinterpret_cast<glm::mat4*>(reinterpret_cast<uint64_t>(m_InstanceUniformBufferObject.model) + (index * m_DynamicAllignment));
-		*model = translate(glm::mat4(), { render_object.x(), render_object.y(), render_object.z() });
-
-		//hack around the const to update m_RotationAngle. //TODO: remove rotation feature or const from m_Scene.renderObjects()
-		auto noconst =  const_cast<RenderObject*>(&render_object);
-		noconst->m_RotationAngle = (render_object.m_RotationAngle + 1) % 360;
-
-		if (TestConfiguration::GetInstance().rotateCubes) {
-			auto rotateX = 0.0001f*(index + 1) * std::pow(-1, index);
-			auto rotateY = 0.0002f*(index + 1) * std::pow(-1, index);
-			auto rotateZ = 0.0003f*(index + 1) * std::pow(-1, index);
-			*model = glm::rotate<float>(*model, render_object.m_RotationAngle * 3.14159268 / 180, glm::tvec3<float>{ rotateX, rotateY, rotateZ });
-		}
+	if (m_PushConstants) {
+		return reinterpret_cast<uint8_t*>(m_InstanceUniformBufferObject.model);
 	}
+	return static_cast<uint8_t*>(m_DynamicUniformBuffer[frameIndex]->map());
+}
+
+void VulkanApplication::updateModelMatrices(uint8_t* destination, size_t first, size_t last)
+{
+	m_Scene.transforms().update(first, last, destination, m_DynamicAllignment, TestConfiguration::GetInstance().rotateCubes);
+}
+
+void VulkanApplication::createFrameGraph()
+{
+	/*
+	 * One run of the graph is one frame:
+	 *
+	 * acquire -+-> matrices[i] ----------------------------> submit
+	 *          \-> prepare -> record[i] -> primary ----------/
+	 *
+	 * matrices[i] writes its range straight into the mapped dynamic uniform buffer of the acquired image, so it has to wait
+	 * for acquire (which also waits until the gpu is done with that image). The secondary buffers only reference the dynamic
+	 * uniform buffer by offset, so recording doesn't wait for the matrices. Every image has its own descriptor set pointing
+	 * at its dynamic uniform buffer, so nothing is written to descriptor sets during a frame. View and projection are shared by all
+	 * images and only written while the device is idle (see updateUniformBuffer), so they aren't part of the graph.
+	 * With push constants the matrices go into a cpu array and are copied into the command buffers instead: matrices[i]
+	 * doesn't need the image, record[i] waits for every matrices[i] since the record ranges are balanced independently of
+	 * the matrix ranges.
+	 * record[i] runs on worker i and records range i, then whatever chunks are left (see recordRanges).
+	 */
+	auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
+	auto objectCount = m_Scene.renderObjects().size();
 
-	memcpy(m_DynamicUniformBuffer[frameIndex]->map(), m_InstanceUniformBufferObject.model, m_DynamicAllignment * m_Scene.renderObjects().size());
-	m_DynamicUniformBuffer[frameIndex]->unmap();
+	m_FrameGraph = std::make_unique<TaskGraph>(*m_ThreadPool);
+	auto& graph = *m_FrameGraph;
 
-	vk::DescriptorBufferInfo dynamicBufferInfo;
-	dynamicBufferInfo.buffer = m_DynamicUniformBuffer[frameIndex]->m_Buffer;
-	dynamicBufferInfo.offset = 0;
-	dynamicBufferInfo.range = m_DynamicAllignment;
+	auto acquire = graph.add("acquire", [this] { acquireImage(); });
 
-	std::array<vk::WriteDescriptorSet, 1> writes = {
-		vk::WriteDescriptorSet(m_DescriptorSet, 1)
-		.setDescriptorCount(1)
-		.setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
-		.setPBufferInfo(&dynamicBufferInfo)
-	};
+	std::vector<TaskGraph::node_t> matrices;
+	for (auto i = 0; i < threadCount; ++i) {
+		matrices.push_back(graph.add("matrices[" + std::to_string(i) + "]", [this, i, threadCount, objectCount] {
+			updateModelMatrices(modelMatrices(m_ImageIndex), i * objectCount / threadCount, (i + 1) * objectCount / threadCount);
+		}));
+		if (!m_PushConstants) {
+			graph.depend(matrices.back(), acquire);
+		}
+	}
+
+	//with reused command buffers the graph submits the buffers recorded at startup
+	auto recorded = acquire;
+	if (!TestConfiguration::GetInstance().reuseCommandBuffers) {
+		auto prepare = graph.add("prepare", [this] { prepareDrawRenderObjectsInfos(m_ImageIndex); });
+		graph.depend(prepare, acquire);
+
+		std::vector<TaskGraph::node_t> records;
+		for (auto i = 0; i < threadCount; ++i) {
+			records.push_back(graph.add("record[" + std::to_string(i) + "]", [this, i] { recordRanges(i); }, recordingThread(i)));
+			graph.depend(records.back(), prepare);
+			if (m_PushConstants) {
+				for (auto node : matrices) {
+					graph.depend(records.back(), node);
+				}
+			}
+		}
 
-	m_LogicalDevice.updateDescriptorSets(writes, {});
+		recorded = graph.add("primary", [this] { recordPrimaryCommandBuffer(m_ImageIndex); });
+		for (auto node : records) {
+			graph.depend(recorded, node);
+		}
+	}
+
+	auto submit = graph.add("submit", [this] { submitFrame(); });
+	graph.depend(submit, recorded);
+	for (auto node : matrices) {
+		graph.depend(submit, node);
+	}
 }
 
 void VulkanApplication::mainLoop() {
@@ -1090,6 +1597,16 @@ void VulkanApplication::mainLoop() {
 		wmiAccesor.Connect("OpenHardwareMonitor");
 	}
 
+	//the probe is a background task on the pool's background thread, so the WMI round trip never holds a draw thread.
+	//One probe at a time, its sample lives out here because a task only holds a few pointers
+	struct ProbeSample
+	{
+		size_t timestamp;
+		size_t id;
+		int fps;
+	} probeSample = {};
+	TaskCounter probeCounter;
+
 	std::stringstream fpsCsv;
 	fpsCsv << "FPS\n";
 
@@ -1101,6 +1618,18 @@ void VulkanApplication::mainLoop() {
 	std::stringstream frametimeCsv;
 	frametimeCsv << "frametime(nanoseconds)\n";
 
+	//one row per draw thread for every recorded frame time, holding what the thread did since the previous sample
+	auto lastThreadStatistics = m_ThreadPool->worker_statistics();
+	std::stringstream threadStatisticsCsv;
+	threadStatisticsCsv << "Sample;Thread;Tasks;Run(ns);Wait(ns);Idle(ns);Contentions\n";
+	size_t threadStatisticsSample = 0;
+
+	//secondary buffers recorded per frame, only interesting when they can come from the cache
+	std::stringstream rerecordCsv;
+	rerecordCsv << "Frame;Rerecorded\n";
+	size_t frameCount = 0;
+	size_t nextTouched = 0;	//<-- render object the "d" key marks as changed
+
 	while ((nanoSec / 1000000000 < testConfig.seconds) || (testConfig.seconds == 0))
 	{
 		MSG message;
@@ -1115,6 +1644,16 @@ void VulkanApplication::mainLoop() {
 					auto& rc = TestConfiguration::GetInstance().rotateCubes;
 					rc = !rc;
 				}
+				//if key pressed is "w": switch between parking and spinning draw threads
+				else if (message.wParam == 87) {
+					auto& wp = TestConfiguration::GetInstance().waitPolicy;
+					wp = wp == WaitPolicy::Park ? WaitPolicy::SpinThenPark : WaitPolicy::Park;
+					m_ThreadPool->set_wait_policy(wp, std::chrono::microseconds(testConfig.spinMicroseconds));
+				}
+				//if key pressed is "d": change the next render object, only its range is recorded again
+				else if (message.wParam == 68 && !m_Scene.renderObjects().empty()) {
+					m_Scene.touch(nextTouched++ % m_Scene.renderObjects().size());
+				}
 			}
 
 			TranslateMessage(&message);
@@ -1141,58 +1680,64 @@ void VulkanApplication::mainLoop() {
 					frametimeCsv << delta << "\n";
 				}
 
+				if (testConfig.recordThreadStatistics) {
+					auto threadStatistics = m_ThreadPool->worker_statistics();
+					for (auto i = 0; i < threadStatistics.size(); ++i) {
+						auto sample = threadStatistics[i] - lastThreadStatistics[i];
+						threadStatisticsCsv << threadStatisticsSample << ";" << i << ";" << sample.tasks << ";" << sample.runNanoseconds << ";"
+							<< sample.waitNanoseconds << ";" << sample.idleNanoseconds << ";" << sample.contentions << "\n";
+					}
+					lastThreadStatistics = threadStatistics;
+					++threadStatisticsSample;
+				}
+
 				if (TestConfiguration::GetInstance().recordFPS) {
 					fpsCsv << oldfps << "\n";
 				}
 			}
 
 			if (testConfig.openHardwareMonitorData &&
-				nanoSec / 1000000 > probeCount * testConfig.probeInterval)
+				nanoSec / 1000000 > probeCount * testConfig.probeInterval &&
+				probeCounter.done())
 			{
-				//QueryItem queries one item from WMI, which is separated into multiple items (put in a vector here)
-				auto items = wmiAccesor.QueryItem("sensor", probeProperties, 3);
-
-				//each item needs a timestamp and an id ( = probeCount) and the last completely measured FPS
-				for (auto& item : items) {
-					item.Timestamp = std::to_string(nanoSec);
-					item.Id = std::to_string(probeCount);
-					item.FPS = std::to_string(oldfps);
-					wmiCollection.Add(item);
-				}
+				probeSample.timestamp = nanoSec;
+				probeSample.id = probeCount;
+				probeSample.fps = oldfps;
+
+				m_ThreadPool->submit(probeCounter, [this, &wmiAccesor, &probeProperties, &probeSample] {
+					//QueryItem queries one item from WMI, which is separated into multiple items (put in a vector here)
+					auto items = wmiAccesor.QueryItem("sensor", probeProperties, 3);
+
+					//each item needs a timestamp and an id ( = probeCount) and the last completely measured FPS
+					for (auto& item : items) {
+						item.Timestamp = std::to_string(probeSample.timestamp);
+						item.Id = std::to_string(probeSample.id);
+						item.FPS = std::to_string(probeSample.fps);
+						wmiCollection.Add(item);
+					}
+				}, TaskPriority::Background);
 
 				++probeCount;
 			}
 
 			//**************************************************
 
-			updateUniformBuffer();
-
 			drawFrame();
 			++fps;
+
+			if (testConfig.cacheCommandBuffers) {
+				rerecordCsv << frameCount << ";" << m_RerecordCount << "\n";
+			}
+			++frameCount;
 		}
 	}
 
 	m_LogicalDevice.waitIdle();
+	m_ThreadPool->wait(probeCounter);
 
-	if (testConfig.pipelineStatistics) {
-		for (auto i = 0; i < testConfig.drawThreadCount; ++i) {
-			auto& queryResult = m_QueryResults[i];
-			PipelineStatisticsDataItem item;
-			item.CInvocations = std::to_string(queryResult.clippingInvocations);
-			item.CommandListId = std::to_string(i);
-			item.CPrimitives = std::to_string(queryResult.clippingPrimitives);
-			item.CSInvocations = std::to_string(queryResult.computeShaderInvocations);
-			item.DSInvocations = "N/A";
-			item.GSInvocations = std::to_string(queryResult.geometryShaderInvocations);
-			item.GSPrimitives = std::to_string(queryResult.geometryShaderPrimitives);
-			item.HSInvocations = "N/A";
-			item.IAPrimitives = std::to_string(queryResult.inputAssemblyPrimitives);
-			item.IAVertices = std::to_string(queryResult.inputAssemblyVertices);
-			item.PSInvocations = std::to_string(queryResult.fragmentShaderInvocations);
-			item.VSInvocations = std::to_string(queryResult.vertexShaderInvocations);
-
-			pipelineStatisticsCollection.Add(item);
-		}
+	//the last frames in flight were not read by acquireImage
+	for (auto i = 0; i < m_PendingFrames.size(); ++i) {
+		readQueries(i);
 	}
 
 	//save files
@@ -1221,8 +1766,30 @@ void VulkanApplication::mainLoop() {
 	}
 
 	if (testConfig.exportCsv) {
-		auto csvStr = testConfig.MakeString(";");
-		SaveToFile("conf_" + fname + ".csv", csvStr);
+		std::stringstream csv;
+		csv << testConfig.MakeString(";");
+
+		//wakeup latency of the draw threads, i.e. time from a task being pushed until an idle thread started it
+		auto wakeups = m_ThreadPool->wakeup_statistics();
+		for (auto i = 0; i < wakeups.size(); ++i) {
+			auto mean = wakeups[i].wakeups > 0 ? wakeups[i].totalNanoseconds / wakeups[i].wakeups : 0;
+			csv << "Thread " << i << " Wakeups" << ";" << wakeups[i].wakeups << "\n";
+			csv << "Thread " << i << " Mean Wakeup (ns)" << ";" << mean << "\n";
+			csv << "Thread " << i << " Max Wakeup (ns)" << ";" << wakeups[i].maxNanoseconds << "\n";
+		}
+
+		//where the record ranges ended up, and how uneven their recording times were in the last balanced frame
+		for (auto i = 0; i < m_RecordRanges.rangeCount(); ++i) {
+			auto range = m_RecordRanges.range(i);
+			csv << "Range " << i << ";" << range.first << " " << range.second << "\n";
+		}
+		csv << "Record Imbalance" << ";" << m_RecordRanges.imbalance() << "\n";
+
+		//how the device memory is split up at the end of the run
+		csv << m_Allocator->MakeString(";");
+		csv << m_Uploads->MakeString(";");
+
+		SaveToFile("conf_" + fname + ".csv", csv.str());
 	}
 
 	if (testConfig.recordFPS) {
@@ -1233,29 +1800,68 @@ void VulkanApplication::mainLoop() {
 		SaveToFile("frameTime_" + fname + ".csv", frametimeCsv.str());
 	}
 
+	if (testConfig.exportCsv) {
+		SaveToFile("graph_" + fname + ".csv", m_FrameGraph->MakeString(";"));
+	}
+
+	if (testConfig.cacheCommandBuffers) {
+		SaveToFile("rerecord_" + fname + ".csv", rerecordCsv.str());
+	}
+
+	if (testConfig.gpuTimestamps) {
+		SaveToFile("gpuTime_" + fname + ".csv", m_GpuTimeCsv.str());
+	}
+
+	if (testConfig.recordThreadStatistics) {
+		SaveToFile("threadStats_" + fname + ".csv", threadStatisticsCsv.str());
+	}
+
 	delete localNow;
 }
 
 void VulkanApplication::drawFrame() {
+	m_FrameGraph->run();
+
+	//the ranges of the next frame follow the recording times of this one (never with -cacheComBuf, see run)
+	auto& testConfig = TestConfiguration::GetInstance();
+	if (testConfig.balanceRecording && !testConfig.reuseCommandBuffers && !testConfig.cacheCommandBuffers) {
+		m_RecordRanges.update(m_RangeDurations);
+	}
+}
+
+void VulkanApplication::acquireImage() {
+	//the semaphores of this frame are free again once the frame that last used them has finished
+	auto timeout = std::numeric_limits<uint64_t>::max();
+	m_LogicalDevice.waitForFences({ m_InFlightFences[m_CurrentFrame] }, VK_TRUE, timeout);
+
+	auto imageResult = m_LogicalDevice.acquireNextImageKHR(m_SwapChain, timeout, m_ImageAvaliableSemaphores[m_CurrentFrame], vk::Fence());
 
-	// Aquire image
-	auto imageResult = m_LogicalDevice.acquireNextImageKHR(m_SwapChain, std::numeric_limits<uint64_t>::max(), m_ImageAvaliableSemaphore, vk::Fence());
-	updateDynamicUniformBuffer(imageResult.value);
-	
 	if(imageResult.result != vk::Result::eSuccess && imageResult.result != vk::Result::eSuboptimalKHR)
 	{
 		throw std::runtime_error("Failed to acquire swap chain image!");
 	}
 
-	if (!TestConfiguration::GetInstance().reuseCommandBuffers) {
-		recordCommandBuffers(imageResult.value);
+	m_ImageIndex = imageResult.value;
+
+	//command buffers, uniform and indirect buffers are per image. With more images than frames in flight an image
+	//can come back while another frame still renders to it, so wait for that frame before anything is rewritten
+	auto& imageFence = m_ImagesInFlight[m_ImageIndex];
+	if (imageFence && imageFence != m_InFlightFences[m_CurrentFrame]) {
+		m_LogicalDevice.waitForFences({ imageFence }, VK_TRUE, timeout);
 	}
+	imageFence = m_InFlightFences[m_CurrentFrame];
+
+	//the image's last frame has finished, so its queries can be read before they are reset
+	readQueries(m_ImageIndex);
+}
+
+void VulkanApplication::submitFrame() {
 
 	//Submitting Command Buffer
 	vk::SubmitInfo submitInfo = {};
 
 	// Wait in this stage until semaphore is aquired
-	vk::Semaphore  waitSemaphores[] = { m_ImageAvaliableSemaphore };
+	vk::Semaphore  waitSemaphores[] = { m_ImageAvaliableSemaphores[m_CurrentFrame] };
 	vk::PipelineStageFlags waitStages[] = {
 		vk::PipelineStageFlagBits::eColorAttachmentOutput
 	};
@@ -1263,17 +1869,31 @@ void VulkanApplication::drawFrame() {
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 
-	auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
-
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_StartCommandBuffers[imageResult.value];
+	submitInfo.pCommandBuffers = &m_StartCommandBuffers[m_ImageIndex];
+
+	//-primaryPerThread: the start buffer clears, then the range buffers draw in range order, all in this one submit
+	std::vector<vk::CommandBuffer> commandBuffers;
+	if (TestConfiguration::GetInstance().primaryPerThread) {
+		auto rangeCount = m_RecordRanges.rangeCount();
+		commandBuffers.push_back(m_StartCommandBuffers[m_ImageIndex]);
+		commandBuffers.insert(commandBuffers.end(), m_DrawCommandBuffers.begin() + m_ImageIndex * rangeCount, m_DrawCommandBuffers.begin() + (m_ImageIndex + 1) * rangeCount);
+		submitInfo.commandBufferCount = commandBuffers.size();
+		submitInfo.pCommandBuffers = commandBuffers.data();
+	}
 
 	// Specify which sempahore to signal once command buffers have been executed.
-	vk::Semaphore signalSemaphores[] = { m_RenderFinishedSemaphore };
+	vk::Semaphore signalSemaphores[] = { m_RenderFinishedSemaphores[m_CurrentFrame] };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	m_GraphicsQueue.submit({ submitInfo }, vk::Fence());
+	//the fence tells acquireImage when this frame's semaphores and image resources are free again
+	m_LogicalDevice.resetFences({ m_InFlightFences[m_CurrentFrame] });
+	m_GraphicsQueue.submit({ submitInfo }, m_InFlightFences[m_CurrentFrame]);
+	if (TestConfiguration::GetInstance().gpuTimestamps || TestConfiguration::GetInstance().pipelineStatistics) {
+		m_PendingFrames[m_ImageIndex] = m_FrameNumber;
+	}
+	++m_FrameNumber;
 
 	// Present the image presented
 	vk::PresentInfoKHR presentInfo = {};
@@ -1283,31 +1903,18 @@ void VulkanApplication::drawFrame() {
 	vk::SwapchainKHR swapChains[] = { m_SwapChain };
 	presentInfo.swapchainCount = 1;
 	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageResult.value;
+	presentInfo.pImageIndices = &m_ImageIndex;
 
 	presentInfo.pResults = nullptr; // Would contain VK result for all images if more than 1
 
 	m_PresentQueue.presentKHR(presentInfo);
-	
-	//TODO: move this up to the beginning?
-	m_PresentQueue.waitIdle();
-	
-	if (TestConfiguration::GetInstance().pipelineStatistics) {
-		if(m_LogicalDevice.getQueryPoolResults(
-			m_QueryPool, 
-			0, 
-			threadCount,
-			sizeof(PipelineStatisticsResult) * threadCount, 
-			m_QueryResults.data(), 
-			sizeof uint64_t, 
-			vk::QueryResultFlagBits::eWait | vk::QueryResultFlagBits::e64) != vk::Result::eSuccess)
-		{
-			throw std::runtime_error("Failed get the query results from the logical device");
-		}
-	}
+
+	//no wait here, the next frame is recorded while the GPU works on this one
+	m_CurrentFrame = (m_CurrentFrame + 1) % m_InFlightFences.size();
 }
 
 void VulkanApplication::cleanup() {
+	m_FrameGraph.reset();
 	delete m_ThreadPool;
 	cleanupSwapChain();
 
@@ -1317,8 +1924,11 @@ void VulkanApplication::cleanup() {
 	m_LogicalDevice.destroyDescriptorPool(m_DescriptorPool);
 	m_LogicalDevice.destroyDescriptorSetLayout(m_DescriptorSetLayout);
 
-	m_LogicalDevice.destroySemaphore(m_RenderFinishedSemaphore);
-	m_LogicalDevice.destroySemaphore(m_ImageAvaliableSemaphore);
+	for (auto i = 0; i < m_InFlightFences.size(); ++i) {
+		m_LogicalDevice.destroySemaphore(m_RenderFinishedSemaphores[i]);
+		m_LogicalDevice.destroySemaphore(m_ImageAvaliableSemaphores[i]);
+		m_LogicalDevice.destroyFence(m_InFlightFences[i]);
+	}
 
 	
 	for (auto& pool : m_CommandPool) {
@@ -1326,18 +1936,27 @@ void VulkanApplication::cleanup() {
 	}
 
 	m_LogicalDevice.destroyCommandPool(m_StartCommandPool);
-	m_LogicalDevice.destroyCommandPool(m_SingleTimeCommandPool);
 
-	m_LogicalDevice.destroyQueryPool(m_QueryPool);
+	for (auto& pool : m_QueryPools) {
+		m_LogicalDevice.destroyQueryPool(pool);
+	}
+	if (m_TimestampQueryPool) {
+		m_LogicalDevice.destroyQueryPool(m_TimestampQueryPool);
+	}
 	m_VertexBuffer = nullptr;
 	m_IndexBuffer = nullptr;
 	m_UniformBuffer = nullptr;
-	m_DynamicUniformBuffer;
 	for (auto& dynBuf : m_DynamicUniformBuffer) {
 		dynBuf = nullptr;
 	}
+	for (auto& indirectBuffer : m_IndirectBuffer) {
+		indirectBuffer->unmap();
+		indirectBuffer = nullptr;
+	}
 	m_TextureImage = nullptr;
 	m_DepthImage = nullptr;
+	m_Uploads = nullptr;	//<-- holds the staging ring, so before the allocator
+	m_Allocator = nullptr;
 	m_LogicalDevice.destroy();
 	m_Instance->destroySurfaceKHR(m_Surface);
 }
@@ -1355,6 +1974,8 @@ void VulkanApplication::recreateSwapChain()
 	createDepthResources();
 	createFramebuffers();
 	createCommandBuffer();
+	updateUniformBuffer();	//<-- the aspect ratio may have changed
+	m_Uploads->flush();	//<-- the depth image transition
 }
 
 void VulkanApplication::cleanupSwapChain()
@@ -1365,8 +1986,8 @@ void VulkanApplication::cleanupSwapChain()
 		m_LogicalDevice.destroyFramebuffer(frameBuffer);
 	}
 
-	auto threadCount = TestConfiguration::GetInstance().drawThreadCount;
-	for (auto i = 0; i < threadCount * framebufferCount; ++i) {
+	auto rangeCount = m_RecordRanges.rangeCount();
+	for (auto i = 0; i < rangeCount * framebufferCount; ++i) {
 		//TODO: free properly. see command buffer allocation for distribution on pools.
 		m_LogicalDevice.freeCommandBuffers(m_CommandPool[i], m_DrawCommandBuffers[i]);
 	}
@@ -1378,6 +1999,9 @@ void VulkanApplication::cleanupSwapChain()
 	m_LogicalDevice.destroyPipelineLayout(m_PipelineLayout);
 
 	m_LogicalDevice.destroyRenderPass(m_RenderPass);
+	if (m_LoadRenderPass) {
+		m_LogicalDevice.destroyRenderPass(m_LoadRenderPass);
+	}
 
 	for (auto imageView : m_SwapChainImageViews) {
 		m_LogicalDevice.destroyImageView(imageView);
@@ -1386,20 +2010,6 @@ void VulkanApplication::cleanupSwapChain()
 	m_LogicalDevice.destroySwapchainKHR(m_SwapChain);
 }
 
-void VulkanApplication::copyBuffer(vk::Buffer source, vk::Buffer destination, vk::DeviceSize size)
-{
-	auto commandBuffer = beginSingleTimeCommands();
-
-	vk::BufferCopy copyRegion;
-	copyRegion.srcOffset = 0; 
-	copyRegion.dstOffset = 0; 
-	copyRegion.size = size;
-
-	commandBuffer.copyBuffer(source, destination, { copyRegion });
-
-	endSingleTimeCommands(commandBuffer);
-}
-
 void VulkanApplication::createTextureImage()
 {
 	int texWidth, texHeight, texChannels;
@@ -1410,17 +2020,6 @@ void VulkanApplication::createTextureImage()
 	}
 	vk::DeviceSize imageSize = texWidth * texHeight * 4;
 
-	vk::BufferCreateInfo buffer_create_info;
-	buffer_create_info.setSize(imageSize)
-		.setUsage(vk::BufferUsageFlagBits::eTransferSrc);
-
-	Buffer buffer(m_PhysicalDevice, m_LogicalDevice, buffer_create_info, vk::MemoryPropertyFlagBits::eHostVisible| vk::MemoryPropertyFlagBits::eHostCoherent);
-
-	memcpy(buffer.map(), pixels, imageSize);
-	buffer.unmap();
-
-	stbi_image_free(pixels);
-
 	vk::ImageCreateInfo imageCreateInfo;
 	imageCreateInfo.setImageType(vk::ImageType::e2D)
 		.setFormat(vk::Format::eR8G8B8A8Unorm)
@@ -1430,47 +2029,19 @@ void VulkanApplication::createTextureImage()
 		.setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
 		.setInitialLayout(vk::ImageLayout::eUndefined);
 
-	m_TextureImage = std::make_unique<Image>(m_LogicalDevice, m_PhysicalDevice, imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
+	m_TextureImage = std::make_unique<Image>(*m_Allocator, imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, vk::ImageAspectFlagBits::eColor);
 	transitionImageLayout(m_TextureImage->m_Image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-	copyBufferToImage(buffer.m_Buffer, m_TextureImage->m_Image, texWidth, texHeight);
+	m_Uploads->uploadImage(pixels, imageSize, m_TextureImage->m_Image, vk::ImageAspectFlagBits::eColor, texWidth, texHeight);
+
+	//the pixels are in the staging ring now
+	stbi_image_free(pixels);
 
 	//prepare to use image in shader:
 	transitionImageLayout(m_TextureImage->m_Image, vk::Format::eR8G8B8A8Unorm, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
 }
 
-vk::CommandBuffer VulkanApplication::beginSingleTimeCommands() const
-{
-	vk::CommandBufferAllocateInfo allocInfo = {};
-	allocInfo.level = vk::CommandBufferLevel::ePrimary;
-	allocInfo.commandPool = m_SingleTimeCommandPool;
-	allocInfo.commandBufferCount = 1;
-
-	vk::CommandBuffer commandBuffer = m_LogicalDevice.allocateCommandBuffers(allocInfo)[0];
-
-	vk::CommandBufferBeginInfo beginInfo = {};
-	beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-	commandBuffer.begin(beginInfo);
-	return commandBuffer;
-}
-
-void VulkanApplication::endSingleTimeCommands(vk::CommandBuffer commandBuffer)
-{
-	commandBuffer.end();
-
-	vk::SubmitInfo submitInfo;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	m_GraphicsQueue.submit({ submitInfo }, vk::Fence());
-	m_GraphicsQueue.waitIdle();
-
-	m_LogicalDevice.freeCommandBuffers(m_SingleTimeCommandPool, { commandBuffer });
-}
-
 void VulkanApplication::transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout)
 {
-	auto commandBuffer = beginSingleTimeCommands();
-
 	vk::ImageAspectFlags aspect_mask = vk::ImageAspectFlagBits::eColor;
 
 	// Special case for depth buffer image
@@ -1482,74 +2053,8 @@ void VulkanApplication::transitionImageLayout(vk::Image image, vk::Format format
 			aspect_mask |= vk::ImageAspectFlagBits::eStencil;
 		}
 	}
-	
-	vk::PipelineStageFlags sourceStage;
-	vk::PipelineStageFlags destinationStage;
-	vk::AccessFlags source_access_mask;
-	vk::AccessFlags destination_access_mask;
-
-	if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal) {
-		source_access_mask = vk::AccessFlags();
-		destination_access_mask = vk::AccessFlagBits::eTransferWrite;
-
-		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eTransfer;
-	}
-	else if (oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal) {
-		source_access_mask = vk::AccessFlagBits::eTransferWrite;
-		destination_access_mask = vk::AccessFlagBits::eShaderRead;
-
-		sourceStage = vk::PipelineStageFlagBits::eTransfer;
-		destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-	}
-	else if (oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal) {
-		source_access_mask = vk::AccessFlags();
-		destination_access_mask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-		sourceStage = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-	}
-	else {
-		throw std::invalid_argument("unsupported layout transition!");
-	}
-
-	auto image_memory_barrier = vk::ImageMemoryBarrier(
-		source_access_mask, 
-		destination_access_mask, 
-		oldLayout, 
-		newLayout, 
-		VK_QUEUE_FAMILY_IGNORED, 
-		VK_QUEUE_FAMILY_IGNORED, 
-		image, 
-		{ aspect_mask, 0, 1, 0, 1 });
-
-	commandBuffer.pipelineBarrier(sourceStage, destinationStage, vk::DependencyFlags(), {}, {}, { image_memory_barrier });
-
-	endSingleTimeCommands(commandBuffer);
-}
-
-void VulkanApplication::copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
-{
-	auto commandBuffer = beginSingleTimeCommands();
-
-	vk::BufferImageCopy region;
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-	region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-	region.imageOffset = vk::Offset3D { 0,0,0 };
-	region.imageExtent = vk::Extent3D {
-		width,
-		height,
-		1
-	};
-
-	commandBuffer.copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, { region });
 
-	endSingleTimeCommands(commandBuffer);
+	m_Uploads->transitionImageLayout(image, aspect_mask, oldLayout, newLayout);
 }
 
 
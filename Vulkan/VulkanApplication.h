@@ -6,14 +6,20 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <sstream>
 
 #include "../scene-window-system/Window.h"
 #include "../scene-window-system/Scene.h"
 #include "../scene-window-system/TestConfiguration.h"
 #include "../scene-window-system/WmiAccess.h"
 #include "../scene-window-system/ThreadPool.h"
+#include "../scene-window-system/TaskGraph.h"
+#include "../scene-window-system/RangeBalancer.h"
 
 #include "Buffer.h"
+#include "MemoryAllocator.h"
+#include "UploadManager.h"
 #include "Image.h"
 #include "Instance.h"
 
@@ -44,7 +50,7 @@ private:
 
 	struct
 	{
-		glm::mat4* model = nullptr;
+		glm::mat4* model = nullptr;	//<-- only allocated for -pushConstants
 	} m_InstanceUniformBufferObject;
 
 	Window m_Window;
@@ -52,6 +58,8 @@ private:
 	Instance m_Instance;
 	vk::PhysicalDevice m_PhysicalDevice;
 	vk::Device m_LogicalDevice;
+	std::unique_ptr<MemoryAllocator> m_Allocator;
+	std::unique_ptr<UploadManager> m_Uploads;	//<-- staging and one-time transfer commands, submitted in batches
 	vk::Queue m_GraphicsQueue;
 	vk::SurfaceKHR m_Surface;
 	vk::Queue m_PresentQueue;
@@ -64,18 +72,22 @@ private:
 	std::vector<vk::Framebuffer> m_SwapChainFramebuffers;
 
 	vk::RenderPass m_RenderPass;
+	vk::RenderPass m_LoadRenderPass;	//<-- -primaryPerThread: continues where the previous pass of the frame stopped
 	vk::DescriptorSetLayout m_DescriptorSetLayout;
 	vk::PipelineLayout m_PipelineLayout;
 	vk::Pipeline m_GraphicsPipeline;
 
-	vk::CommandPool m_SingleTimeCommandPool;
 	vk::CommandPool m_StartCommandPool;
 	std::vector<vk::CommandPool> m_CommandPool;
 	std::vector<vk::CommandBuffer> m_DrawCommandBuffers;
 	std::vector<vk::CommandBuffer> m_StartCommandBuffers;	//<-- one for each frame buffer
 
-	vk::Semaphore m_ImageAvaliableSemaphore;
-	vk::Semaphore m_RenderFinishedSemaphore;
+	//one of each per frame in flight, m_CurrentFrame picks the set of the frame being built
+	std::vector<vk::Semaphore> m_ImageAvaliableSemaphores;
+	std::vector<vk::Semaphore> m_RenderFinishedSemaphores;
+	std::vector<vk::Fence> m_InFlightFences;
+	std::vector<vk::Fence> m_ImagesInFlight;	//<-- fence of the frame last rendering to each swap chain image, may be null
+	size_t m_CurrentFrame = 0;
 
 
 	std::unique_ptr<Buffer> m_VertexBuffer;
@@ -83,20 +95,42 @@ private:
 	
 	std::unique_ptr<Buffer> m_UniformBuffer;
 	std::vector<std::unique_ptr<Buffer>> m_DynamicUniformBuffer;	//<-- one for each frame buffer
+	std::vector<std::unique_ptr<Buffer>> m_IndirectBuffer;	//<-- one for each frame buffer, -indirect only
+	std::vector<vk::DrawIndexedIndirectCommand*> m_IndirectCommands;	//<-- persistent mappings of m_IndirectBuffer
+	bool m_MultiDrawIndirect = false;	//<-- device can draw several indirect commands per call
+	bool m_PushConstants = false;	//<-- model matrices are pushed per draw, see TestConfiguration::pushConstants
 
 	vk::DescriptorPool m_DescriptorPool;
-	vk::DescriptorSet m_DescriptorSet;
+	std::vector<vk::DescriptorSet> m_DescriptorSets;	//<-- one for each frame buffer, binding 1 is its dynamic uniform buffer
 	std::unique_ptr<Image> m_TextureImage;
 	vk::Sampler m_TextureSampler;
 	std::unique_ptr<Image> m_DepthImage;
 	uint32_t m_DynamicAllignment;
-	vk::QueryPool m_QueryPool;
-	std::vector<PipelineStatisticsResult> m_QueryResults;
+	std::vector<vk::QueryPool> m_QueryPools;	//<-- pipeline statistics, one query per range, one pool per swap chain image
+	std::vector<int64_t> m_PendingFrames;	//<-- frame whose queries wait to be read on each swap chain image, -1 for none
+	size_t m_FrameNumber = 0;
+
+	//-gpuTimestamps: every swap chain image has its own slice of the pool, read once the image's last frame finished
+	static const uint32_t s_PassTimestamps = 4;	//<-- start and end of both render passes, the range timestamps follow
+	vk::QueryPool m_TimestampQueryPool;
+	uint32_t m_TimestampsPerImage = 0;
+	double m_TimestampPeriod = 1.0;	//<-- ns per tick
+	uint64_t m_TimestampMask = ~0ull;	//<-- the bits of a timestamp the device actually writes
+	std::stringstream m_GpuTimeCsv;
+	std::vector<PipelineStatisticsResult> m_QueryResults;	//<-- read buffer for one pool
 
 	DataCollection<WMIDataItem> wmiCollection;
 	DataCollection<PipelineStatisticsDataItem> pipelineStatisticsCollection;
 
 	ThreadPool* m_ThreadPool;
+	std::vector<DrawRenderObjectsInfo> m_DrawRenderObjectsInfos;	//<-- one for each draw thread, reused every frame
+	std::unique_ptr<TaskGraph> m_FrameGraph;	//<-- the stages of one frame, see createFrameGraph
+	uint32_t m_ImageIndex = 0;	//<-- swap chain image of the frame in flight
+	RangeBalancer m_RecordRanges;	//<-- render objects of every secondary buffer, drawThreadCount * recordChunks ranges
+	std::vector<uint64_t> m_RangeDurations;	//<-- recording time of every range in the last frame (ns)
+	std::atomic<size_t> m_NextRange{ 0 };	//<-- next chunk an idle draw thread pulls, see recordRanges
+	std::vector<RecordedRange> m_RecordedRanges;	//<-- contents of every secondary buffer, indexed like m_DrawCommandBuffers
+	std::atomic<size_t> m_RerecordCount{ 0 };	//<-- secondary buffers recorded in the current frame
 
 	static const std::vector<const char*> s_DeviceExtensions;
 	static const std::vector<Vertex> s_Vertices;
@@ -107,17 +141,22 @@ private:
 	void createDescriptorSetLayout();
 	void createUniformBuffer();
 	void createDescriptorPool();
-	void createDescriptorSet();
+	void createIndirectBuffers();
+	void createDescriptorSets();
 	vk::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspect_flags = vk::ImageAspectFlagBits::eColor) const;
 	void createTextureSampler();
 	vk::Format findSupportedFormat(const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features) const;
 	vk::Format findDepthFormat() const;
 	void createDepthResources();
 	void createQueryPool();
+	uint32_t firstTimestamp(uint32_t frameIndex) const { return frameIndex * m_TimestampsPerImage; }
+	void readQueries(uint32_t frameIndex);	//<-- collects the queries of the image's last frame, which must have finished
+	void readTimestamps(uint32_t frameIndex, int64_t frame);
+	void readPipelineStatistics(uint32_t frameIndex, int64_t frame);
 	// Initializes Vulkan
 	void initVulkan();
 
-	void createSemaphores();
+	void createSyncObjects();
 
 	void createCommandBuffer();
 
@@ -165,13 +204,21 @@ private:
 
 	// Finds and returns the "optimal" extent (i.e. resolution) for images in swapchain 
 	vk::Extent2D chooseSwapExtend(const vk::SurfaceCapabilitiesKHR& capabilities) const;
+	// Writes view and projection. The camera doesn't move, so only at startup and when the swap chain (i.e. the aspect ratio) changes,
+	// never while frames that read the buffer are in flight
 	void updateUniformBuffer();
-	void updateDynamicUniformBuffer(int frameIndex) const;
+	// Where the model matrices of a frame go, dynamicAllignment apart: the mapped dynamic uniform buffer, or the cpu array with push constants
+	uint8_t* modelMatrices(uint32_t frameIndex) const;
+	void updateModelMatrices(uint8_t* destination, size_t first, size_t last);
 
 	// Handles (window) events
 	void mainLoop();
 
+	// Runs the frame graph once
 	void drawFrame();
+	void createFrameGraph();
+	void acquireImage();
+	void submitFrame();
 
 	// Destroys allocated stuff gracefully
 	void cleanup();
@@ -180,15 +227,18 @@ private:
 
 	void cleanupSwapChain();
 
-	void copyBuffer(vk::Buffer source, vk::Buffer destination, vk::DeviceSize);
-
 	void createTextureImage();
 
-	vk::CommandBuffer beginSingleTimeCommands() const;
-	void endSingleTimeCommands(vk::CommandBuffer commandBuffer);
+	// Recorded into m_Uploads, done once the uploads are flushed
 	void transitionImageLayout(vk::Image image, vk::Format format, vk::ImageLayout oldLayout, vk::ImageLayout newLayout);
-	void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
 
 	void recordCommandBuffers(uint32_t frameIndex);
+	std::pair<size_t, size_t> objectRange(size_t rangeIndex) const;	//<-- [first, last) render objects of one range
+	size_t recordingThread(size_t rangeIndex) const;	//<-- pool worker that records the secondary buffer of a range
+	void prepareDrawRenderObjectsInfos(uint32_t frameIndex);
+	void recordPrimaryCommandBuffer(uint32_t frameIndex);
+	void recordRange(size_t rangeIndex);	//<-- draw commands of one range, as secondary buffer or indirect commands
+	void recordRanges(size_t worker);	//<-- the fixed range of a draw thread, then chunks pulled from m_NextRange
 	static void DrawRenderObjects(DrawRenderObjectsInfo& info);
+	static void WriteIndirectCommands(DrawRenderObjectsInfo& info);
 };
@@ -2,13 +2,19 @@
 echo compiling!
 
 C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V shader.vert
+C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V instanced.vert -o instanced.spv
+C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V pushconstant.vert -o pushconstant.spv
 C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V shader.frag
 C:/VulkanSDK/1.0.65.0/Bin32/glslangValidator.exe -V skull.frag -o skull.spv
 
 xcopy /Y .\vert.spv ..\x64\Debug\shaders\vert.spv*
+xcopy /Y .\instanced.spv ..\x64\Debug\shaders\instanced.spv*
+xcopy /Y .\pushconstant.spv ..\x64\Debug\shaders\pushconstant.spv*
 xcopy /Y .\frag.spv ..\x64\Debug\shaders\frag.spv*
 xcopy /Y .\skull.spv ..\x64\Debug\shaders\skull.spv*
 xcopy /Y .\vert.spv ..\x64\Release\shaders\vert.spv*
+xcopy /Y .\instanced.spv ..\x64\Release\shaders\instanced.spv*
+xcopy /Y .\pushconstant.spv ..\x64\Release\shaders\pushconstant.spv*
 xcopy /Y .\frag.spv ..\x64\Release\shaders\frag.spv*
 xcopy /Y .\skull.spv ..\x64\Release\shaders\skull.spv*
 xcopy /Y .\texture.png ..\x64\Debug\textures\texture.png*
@@ -0,0 +1,264 @@
+#include "CpuTopology.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <sstream>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+const char* ToString(ThreadPlacement placement)
+{
+	switch (placement)
+	{
+	case ThreadPlacement::PhysicalCores:
+		return "cores";
+	default:
+		return "none";
+	}
+}
+
+ThreadPlacement ParseThreadPlacement(const std::string& name)
+{
+	if (name == "cores") {
+		return ThreadPlacement::PhysicalCores;
+	}
+	if (name == "none") {
+		return ThreadPlacement::None;
+	}
+	throw std::runtime_error("Unknown thread placement: " + name);
+}
+
+namespace
+{
+#if defined(_WIN32)
+	std::vector<LogicalProcessor> detectProcessors()
+	{
+		DWORD length = 0;
+		GetLogicalProcessorInformation(nullptr, &length);
+		std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> infos(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+		if (infos.empty() || !GetLogicalProcessorInformation(infos.data(), &length)) {
+			return {};
+		}
+
+		std::map<unsigned, LogicalProcessor> processors;	//<-- keyed by logical processor index
+		unsigned core = 0, package = 0;
+
+		// the masks only cover the processor group of the calling thread, so at most 64 logical processors
+		for (auto& info : infos) {
+			for (unsigned bit = 0; bit < sizeof(ULONG_PTR) * 8; ++bit) {
+				if (!(info.ProcessorMask & (ULONG_PTR(1) << bit))) {
+					continue;
+				}
+
+				auto& processor = processors[bit];
+				processor.id = bit;
+				switch (info.Relationship) {
+				case RelationProcessorCore:
+					processor.core = core;
+					break;
+				case RelationProcessorPackage:
+					processor.package = package;
+					break;
+				case RelationNumaNode:
+					processor.numaNode = info.NumaNode.NodeNumber;
+					break;
+				default:
+					break;
+				}
+			}
+
+			if (info.Relationship == RelationProcessorCore) {
+				++core;
+			}
+			else if (info.Relationship == RelationProcessorPackage) {
+				++package;
+			}
+		}
+
+		std::vector<LogicalProcessor> result;
+		for (auto& processor : processors) {
+			result.push_back(processor.second);
+		}
+		return result;
+	}
+#elif defined(__linux__)
+	// Parses sysfs cpu lists such as "0-3,8-11".
+	std::vector<unsigned> parseCpuList(const std::string& list)
+	{
+		std::vector<unsigned> result;
+		std::stringstream ss(list);
+		std::string range;
+		while (std::getline(ss, range, ',')) {
+			if (range.empty() || range == "\n") {
+				continue;
+			}
+			auto dash = range.find('-');
+			auto first = static_cast<unsigned>(std::stoul(range.substr(0, dash)));
+			auto last = dash == std::string::npos ? first : static_cast<unsigned>(std::stoul(range.substr(dash + 1)));
+			for (auto cpu = first; cpu <= last; ++cpu) {
+				result.push_back(cpu);
+			}
+		}
+		return result;
+	}
+
+	bool readSysfs(const std::string& path, std::string& value)
+	{
+		std::ifstream file(path);
+		return static_cast<bool>(std::getline(file, value));
+	}
+
+	std::vector<LogicalProcessor> detectProcessors()
+	{
+		std::string online;
+		if (!readSysfs("/sys/devices/system/cpu/online", online)) {
+			return {};
+		}
+
+		std::map<unsigned, unsigned> nodeOfCpu;
+		std::string nodes;
+		if (readSysfs("/sys/devices/system/node/online", nodes)) {
+			for (auto node : parseCpuList(nodes)) {
+				std::string cpus;
+				if (readSysfs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", cpus)) {
+					for (auto cpu : parseCpuList(cpus)) {
+						nodeOfCpu[cpu] = node;
+					}
+				}
+			}
+		}
+
+		// core_id is only unique within a package, so cores are identified by (package, core_id)
+		std::map<std::pair<unsigned, unsigned>, unsigned> coreIndices;
+		std::vector<LogicalProcessor> result;
+		for (auto cpu : parseCpuList(online)) {
+			auto topology = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+			std::string coreId, packageId;
+			if (!readSysfs(topology + "core_id", coreId) || !readSysfs(topology + "physical_package_id", packageId)) {
+				return {};
+			}
+
+			LogicalProcessor processor = {};
+			processor.id = cpu;
+			processor.package = static_cast<unsigned>(std::stoul(packageId));
+			processor.numaNode = nodeOfCpu.count(cpu) ? nodeOfCpu[cpu] : 0;
+
+			auto key = std::make_pair(processor.package, static_cast<unsigned>(std::stoul(coreId)));
+			if (!coreIndices.count(key)) {
+				auto index = static_cast<unsigned>(coreIndices.size());
+				coreIndices[key] = index;
+			}
+			processor.core = coreIndices[key];
+			result.push_back(processor);
+		}
+		return result;
+	}
+#else
+	std::vector<LogicalProcessor> detectProcessors()
+	{
+		return {};
+	}
+#endif
+}
+
+CpuTopology CpuTopology::Detect()
+{
+	CpuTopology topology;
+	topology.m_Processors = detectProcessors();
+
+	// without topology information, treat every hardware thread as its own core
+	if (topology.m_Processors.empty()) {
+		auto count = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned i = 0; i < count; ++i) {
+			topology.m_Processors.push_back({ i, i, 0, 0, 0 });
+		}
+	}
+
+	// number the hardware threads within each core
+	std::map<unsigned, unsigned> threadsPerCore;
+	for (auto& processor : topology.m_Processors) {
+		processor.smtIndex = threadsPerCore[processor.core]++;
+	}
+
+	return topology;
+}
+
+size_t CpuTopology::physicalCoreCount(int numaNode) const
+{
+	std::set<unsigned> cores;
+	for (auto& processor : m_Processors) {
+		if (numaNode < 0 || processor.numaNode == static_cast<unsigned>(numaNode)) {
+			cores.insert(processor.core);
+		}
+	}
+	return cores.size();
+}
+
+size_t CpuTopology::defaultThreadCount(int numaNode) const
+{
+	auto cores = physicalCoreCount(numaNode);
+	return cores > 1 ? cores - 1 : 1;
+}
+
+std::vector<unsigned> CpuTopology::placement(ThreadPlacement policy, size_t threadCount, int numaNode) const
+{
+	if (policy == ThreadPlacement::None) {
+		return {};
+	}
+
+	std::vector<LogicalProcessor> candidates;
+	for (auto& processor : m_Processors) {
+		if (numaNode < 0 || processor.numaNode == static_cast<unsigned>(numaNode)) {
+			candidates.push_back(processor);
+		}
+	}
+
+	if (candidates.empty()) {
+		throw std::runtime_error("No logical processors on NUMA node " + std::to_string(numaNode));
+	}
+
+	// first hardware thread of every core before any SMT sibling, cores of one node kept together
+	std::stable_sort(candidates.begin(), candidates.end(), [](const LogicalProcessor& lhs, const LogicalProcessor& rhs) {
+		if (lhs.smtIndex != rhs.smtIndex) return lhs.smtIndex < rhs.smtIndex;
+		if (lhs.numaNode != rhs.numaNode) return lhs.numaNode < rhs.numaNode;
+		if (lhs.package != rhs.package) return lhs.package < rhs.package;
+		return lhs.core < rhs.core;
+	});
+
+	// main thread + workers, wrapping around if there are more threads than logical processors
+	std::vector<unsigned> result;
+	for (size_t i = 0; i < threadCount + 1; ++i) {
+		result.push_back(candidates[i % candidates.size()].id);
+	}
+	return result;
+}
+
+bool CpuTopology::PinCurrentThread(unsigned processor)
+{
+#if defined(_WIN32)
+	if (processor >= sizeof(DWORD_PTR) * 8) {
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << processor) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	return false;
+#endif
+}
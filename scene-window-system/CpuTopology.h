@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class ThreadPlacement
+{
+	None,			//<-- leave scheduling to the OS
+	PhysicalCores	//<-- one thread per physical core first, SMT siblings only when the cores run out
+};
+
+const char* ToString(ThreadPlacement placement);
+ThreadPlacement ParseThreadPlacement(const std::string& name);
+
+struct LogicalProcessor
+{
+	unsigned id;		//<-- OS index of the logical processor, used for pinning
+	unsigned core;		//<-- physical core, unique across packages
+	unsigned package;
+	unsigned numaNode;
+	unsigned smtIndex;	//<-- 0 for the first hardware thread of a core, 1 for its sibling, ...
+};
+
+/*
+ * Logical processors of the machine with their core, package and NUMA node.
+ * Read from sysfs on Linux and GetLogicalProcessorInformation on Windows.
+ */
+class CpuTopology
+{
+public:
+	static CpuTopology Detect();
+
+	const std::vector<LogicalProcessor>& processors() const { return m_Processors; }
+	size_t physicalCoreCount(int numaNode = -1) const;
+
+	// Draw threads to use when none are given: one per physical core, minus the core left for the main thread.
+	size_t defaultThreadCount(int numaNode = -1) const;
+
+	// Logical processors to pin the main thread (first entry) and threadCount workers (the rest) to.
+	// Empty for ThreadPlacement::None. numaNode < 0 allows every node.
+	std::vector<unsigned> placement(ThreadPlacement policy, size_t threadCount, int numaNode = -1) const;
+
+	// Pins the calling thread to one logical processor. Returns false if the OS refused.
+	static bool PinCurrentThread(unsigned processor);
+
+private:
+	std::vector<LogicalProcessor> m_Processors;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Type-erased void() callable stored in a fixed-size inline buffer.
+ * Unlike std::function it never falls back to the heap: callables that don't fit are rejected at compile time.
+ */
+class InlineTask
+{
+public:
+	static const size_t Capacity = 64;	//<-- bytes available for the callable and its captures
+
+	InlineTask() = default;
+
+	template<class TFunc, class = typename std::enable_if<!std::is_same<typename std::decay<TFunc>::type, InlineTask>::value>::type>
+	InlineTask(TFunc&& func);
+
+	InlineTask(InlineTask&& other) noexcept;
+	InlineTask& operator=(InlineTask&& other) noexcept;
+	InlineTask(const InlineTask&) = delete;
+	InlineTask& operator=(const InlineTask&) = delete;
+	~InlineTask() { reset(); }
+
+	void operator()() { m_Operations->invoke(&m_Storage); }
+	explicit operator bool() const { return m_Operations != nullptr; }
+	void reset();
+
+private:
+	struct Operations
+	{
+		void(*invoke)(void* callable);
+		void(*move)(void* destination, void* source);
+		void(*destroy)(void* callable);
+	};
+
+	template<class TFunc>
+	static const Operations* operations_for();
+
+	typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type m_Storage;
+	const Operations* m_Operations = nullptr;
+};
+
+template<class TFunc>
+inline const InlineTask::Operations* InlineTask::operations_for()
+{
+	static const Operations operations = {
+		[](void* callable) { (*static_cast<TFunc*>(callable))(); },
+		[](void* destination, void* source) { new (destination) TFunc(std::move(*static_cast<TFunc*>(source))); },
+		[](void* callable) { static_cast<TFunc*>(callable)->~TFunc(); }
+	};
+	return &operations;
+}
+
+template<class TFunc, class>
+inline InlineTask::InlineTask(TFunc&& func)
+{
+	using func_t = typename std::decay<TFunc>::type;
+	static_assert(sizeof(func_t) <= Capacity, "Callable is too large for an InlineTask, capture less or capture by pointer");
+	static_assert(alignof(func_t) <= alignof(std::max_align_t), "Callable is over-aligned for an InlineTask");
+
+	new (&m_Storage) func_t(std::forward<TFunc>(func));
+	m_Operations = operations_for<func_t>();
+}
+
+inline InlineTask::InlineTask(InlineTask&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+inline InlineTask& InlineTask::operator=(InlineTask&& other) noexcept
+{
+	if (this != &other)
+	{
+		reset();
+		if (other.m_Operations)
+		{
+			other.m_Operations->move(&m_Storage, &other.m_Storage);
+			m_Operations = other.m_Operations;
+			other.reset();
+		}
+	}
+	return *this;
+}
+
+inline void InlineTask::reset()
+{
+	if (m_Operations)
+	{
+		m_Operations->destroy(&m_Storage);
+		m_Operations = nullptr;
+	}
+}
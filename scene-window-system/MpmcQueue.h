@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's ring buffer).
+ * Every cell carries a sequence number telling producers and consumers whose turn it is, so a push or pop
+ * is a single CAS on the shared position plus a store to the cell. Never allocates after construction.
+ */
+template<class T>
+class MpmcQueue
+{
+public:
+	// capacity must be a power of two
+	explicit MpmcQueue(size_t capacity);
+	MpmcQueue(const MpmcQueue&) = delete;
+	MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+	// false if the queue is full, value is left untouched then
+	bool try_push(T&& value);
+
+	// false if the queue is empty
+	bool try_pop(T& value);
+
+	size_t capacity() const { return m_Mask + 1; }
+
+private:
+	static const size_t s_CacheLine = 64;
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> m_Cells;
+	size_t m_Mask;
+
+	// producers and consumers each get their own cache line
+	char m_Padding0[s_CacheLine];
+	std::atomic<size_t> m_EnqueuePosition;
+	char m_Padding1[s_CacheLine - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_DequeuePosition;
+	char m_Padding2[s_CacheLine - sizeof(std::atomic<size_t>)];
+};
+
+template<class T>
+inline MpmcQueue<T>::MpmcQueue(size_t capacity)
+	: m_Cells(new Cell[capacity]), m_Mask(capacity - 1), m_EnqueuePosition(0), m_DequeuePosition(0)
+{
+	if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+	{
+		throw std::invalid_argument("MpmcQueue capacity must be a power of two");
+	}
+
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		m_Cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+template<class T>
+inline bool MpmcQueue<T>::try_push(T&& value)
+{
+	auto position = m_EnqueuePosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		auto& cell = m_Cells[position & m_Mask];
+		auto sequence = cell.sequence.load(std::memory_order_acquire);
+		auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+		if (difference == 0)
+		{
+			// the cell is free for this position, claim it
+			if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				cell.value = std::move(value);
+				cell.sequence.store(position + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// the cell still holds the value from one lap ago
+			return false;
+		}
+		else
+		{
+			position = m_EnqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+template<class T>
+inline bool MpmcQueue<T>::try_pop(T& value)
+{
+	auto position = m_DequeuePosition.load(std::memory_order_relaxed);
+	while (true)
+	{
+		auto& cell = m_Cells[position & m_Mask];
+		auto sequence = cell.sequence.load(std::memory_order_acquire);
+		auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+
+		if (difference == 0)
+		{
+			if (m_DequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+			{
+				value = std::move(cell.value);
+				// free the cell for the producer one lap ahead
+				cell.sequence.store(position + m_Mask + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (difference < 0)
+		{
+			// nothing has been published at this position yet
+			return false;
+		}
+		else
+		{
+			position = m_DequeuePosition.load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,71 @@
+#include "RangeBalancer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+RangeBalancer::RangeBalancer(size_t itemCount, size_t rangeCount, double damping)
+	: m_Damping(damping)
+{
+	if (rangeCount == 0) {
+		throw std::invalid_argument("RangeBalancer needs at least one range");
+	}
+
+	m_Bounds.resize(rangeCount + 1);
+	for (size_t i = 0; i <= rangeCount; ++i) {
+		m_Bounds[i] = i * itemCount / rangeCount;
+	}
+}
+
+void RangeBalancer::update(const std::vector<uint64_t>& nanoseconds)
+{
+	auto ranges = rangeCount();
+	if (nanoseconds.size() != ranges) {
+		throw std::invalid_argument("RangeBalancer needs one time per range");
+	}
+
+	double total = 0.0;
+	uint64_t longest = 0;
+	for (auto time : nanoseconds) {
+		total += time;
+		longest = std::max(longest, time);
+	}
+
+	if (total <= 0.0 || itemCount() == 0) {
+		return;
+	}
+	m_Imbalance = longest / (total / ranges);
+
+	// cost per item of every range. Empty ranges were not measured, they get the mean so they can grow again
+	auto meanCost = total / itemCount();
+	std::vector<double> itemCost(ranges);
+	for (size_t i = 0; i < ranges; ++i) {
+		auto count = m_Bounds[i + 1] - m_Bounds[i];
+		itemCost[i] = count > 0 ? nanoseconds[i] / static_cast<double>(count) : meanCost;
+	}
+
+	// walk the old ranges and place a new boundary every total / ranges of estimated cost
+	auto target = total / ranges;
+	std::vector<size_t> bounds(m_Bounds);
+	size_t oldRange = 0;
+	double costBefore = 0.0;	//<-- estimated cost of the items before m_Bounds[oldRange]
+	for (size_t i = 1; i < ranges; ++i) {
+		auto wanted = target * i;
+		while (oldRange < ranges - 1 && costBefore + nanoseconds[oldRange] <= wanted) {
+			costBefore += nanoseconds[oldRange];
+			++oldRange;
+		}
+
+		auto items = itemCost[oldRange] > 0.0 ? (wanted - costBefore) / itemCost[oldRange] : 0.0;
+		auto ideal = m_Bounds[oldRange] + items;
+		auto moved = m_Bounds[i] + (ideal - m_Bounds[i]) * m_Damping;
+		bounds[i] = static_cast<size_t>(std::max(0.0, std::round(moved)));
+	}
+
+	// rounding must not reorder the boundaries
+	for (size_t i = 1; i < ranges; ++i) {
+		bounds[i] = std::min(std::max(bounds[i], bounds[i - 1]), itemCount());
+	}
+
+	m_Bounds = bounds;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*
+ * Splits itemCount items into rangeCount consecutive ranges and moves the boundaries so that every range
+ * takes about the same time. update() is fed the measured time of each range; the cost per item is assumed
+ * constant within a range, and the boundaries are moved part of the way towards an equal split of the
+ * estimated cost, which keeps noisy measurements from making them oscillate.
+ */
+class RangeBalancer
+{
+public:
+	RangeBalancer() = default;
+
+	// Starts with an even split, the remainder spread over the first ranges.
+	RangeBalancer(size_t itemCount, size_t rangeCount, double damping = 0.5);
+
+	size_t rangeCount() const { return m_Bounds.empty() ? 0 : m_Bounds.size() - 1; }
+	size_t itemCount() const { return m_Bounds.empty() ? 0 : m_Bounds.back(); }
+
+	// [first, last) items of one range
+	std::pair<size_t, size_t> range(size_t rangeIndex) const { return { m_Bounds[rangeIndex], m_Bounds[rangeIndex + 1] }; }
+
+	// nanoseconds holds the measured time of every range, in range order.
+	void update(const std::vector<uint64_t>& nanoseconds);
+
+	// Longest over mean range time of the last update, 1 is perfectly balanced.
+	double imbalance() const { return m_Imbalance; }
+
+private:
+	std::vector<size_t> m_Bounds;	//<-- rangeCount + 1 boundaries, the first is 0 and the last itemCount
+	double m_Damping = 0.5;			//<-- share of the way towards the new boundaries moved per update
+	double m_Imbalance = 1.0;
+};
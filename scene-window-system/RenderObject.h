@@ -4,8 +4,6 @@ class RenderObject
 public:
 	explicit RenderObject(float x, float y, float z) : m_X(x), m_Y(y), m_Z(z) { }
 
-	int m_RotationAngle;
-
 	float x() const { return m_X; }
 	float y() const { return m_Y; }
 	float z() const { return m_Z; }
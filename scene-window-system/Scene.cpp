@@ -17,6 +17,19 @@ Scene::Scene(Camera& camera, size_t dimensionCubeCount, double paddingFactor) :
 			}
 		}
 	}
+
+	m_ChangeVersions.resize(m_RenderObjects.size(), 0);
+	m_Transforms = TransformStore(m_RenderObjects);
+}
+
+bool Scene::changedSince(size_t first, size_t last, uint64_t version) const
+{
+	for (auto i = first; i < last; ++i) {
+		if (m_ChangeVersions[i] > version) {
+			return true;
+		}
+	}
+	return false;
 }
 
 Scene::~Scene()
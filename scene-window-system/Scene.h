@@ -1,18 +1,35 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include "RenderObject.h"
+#include "TransformStore.h"
 #include "Camera.h"
 
 class Scene
 {
 public:
-	Scene(Camera camera, std::vector<RenderObject> render_objects) : m_Camera(camera), m_RenderObjects(render_objects) {  }
+	Scene(Camera camera, std::vector<RenderObject> render_objects) : m_Camera(camera), m_RenderObjects(render_objects), m_ChangeVersions(m_RenderObjects.size(), 0), m_Transforms(m_RenderObjects) {  }
 	Scene(Camera& camera, size_t dimensionCubeCount, double padding);
 	~Scene();
 
 	const Camera& camera() const { return m_Camera; }
 	const std::vector<RenderObject>& renderObjects() const { return m_RenderObjects; }
+
+	// positions and rotations of the render objects, in the same order
+	TransformStore& transforms() { return m_Transforms; }
+	const TransformStore& transforms() const { return m_Transforms; }
+
+	// The draw parameters of a render object changed, so command buffers drawing it are stale.
+	// Matrix changes don't count, those go through the uniform buffers.
+	void touch(size_t renderObject) { m_ChangeVersions[renderObject] = ++m_Version; }
+	uint64_t version() const { return m_Version; }
+
+	// true if a render object in [first, last) was touched after version
+	bool changedSince(size_t first, size_t last, uint64_t version) const;
 private:
 	Camera m_Camera;
 	std::vector<RenderObject> m_RenderObjects;
+	std::vector<uint64_t> m_ChangeVersions;	//<-- version of the last touch of every render object
+	uint64_t m_Version = 0;
+	TransformStore m_Transforms;
 };
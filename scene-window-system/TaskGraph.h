@@ -0,0 +1,215 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+/*
+ * Named tasks with explicit dependencies, executed on a ThreadPool.
+ * The graph is built once and run as often as needed (e.g. once per frame). A node is submitted to the
+ * pool as soon as all of its dependencies have finished, so independent nodes overlap. Every node is
+ * timed, and MakeString dumps the graph with its timings as csv. A node can be pinned to one worker of the
+ * pool (see ThreadPool::submit_to), otherwise any thread may run it.
+ */
+class TaskGraph
+{
+public:
+	using node_t = size_t;
+	static const size_t any_worker = static_cast<size_t>(-1);
+
+	explicit TaskGraph(ThreadPool& pool) : m_Pool(pool) { }
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph& operator=(const TaskGraph&) = delete;
+
+	node_t add(std::string name, std::function<void()> func, size_t worker = any_worker);
+
+	// node will not start before dependency has finished. Dependencies must be added before their dependents.
+	void depend(node_t node, node_t dependency);
+
+	// Runs every node once. The calling thread executes nodes too. Rethrows the first exception thrown by a node;
+	// nodes depending on a failed node are skipped.
+	void run();
+
+	size_t size() const { return m_Nodes.size(); }
+	const std::string& name(node_t node) const { return m_Nodes[node]->name; }
+	const std::vector<node_t>& dependencies(node_t node) const { return m_Nodes[node]->dependencies; }
+	std::chrono::nanoseconds last_start(node_t node) const { return std::chrono::nanoseconds(m_Nodes[node]->lastStart); }
+	std::chrono::nanoseconds last_duration(node_t node) const { return std::chrono::nanoseconds(m_Nodes[node]->lastDuration); }
+	std::chrono::nanoseconds total_duration(node_t node) const { return std::chrono::nanoseconds(m_Nodes[node]->totalDuration); }
+
+	std::string MakeString(std::string separator) const;
+
+private:
+	using clock_t = std::chrono::steady_clock;
+
+	struct Node
+	{
+		std::string name;
+		std::function<void()> func;
+		std::vector<node_t> dependencies;
+		std::vector<node_t> dependents;
+		size_t worker = any_worker;
+		std::atomic<size_t> remaining{ 0 };	//<-- dependencies not yet finished in the current run
+		std::atomic_bool failed{ false };
+
+		// timings in ns, the start is relative to the start of the run
+		uint64_t runs = 0;
+		uint64_t lastStart = 0;
+		uint64_t lastDuration = 0;
+		uint64_t totalDuration = 0;
+	};
+
+	void schedule(node_t node);
+	void execute(node_t node);
+
+	ThreadPool& m_Pool;
+	std::vector<std::unique_ptr<Node>> m_Nodes;
+	TaskCounter m_Counter;
+	clock_t::time_point m_RunStart;
+
+	std::mutex m_ExceptionMutex;
+	std::exception_ptr m_Exception;
+};
+
+inline TaskGraph::node_t TaskGraph::add(std::string name, std::function<void()> func, size_t worker)
+{
+	if (worker != any_worker && worker >= m_Pool.thread_count())
+	{
+		throw std::out_of_range("TaskGraph node pinned to a worker the pool doesn't have");
+	}
+
+	auto node = std::make_unique<Node>();
+	node->name = std::move(name);
+	node->func = std::move(func);
+	node->worker = worker;
+	m_Nodes.push_back(std::move(node));
+	return m_Nodes.size() - 1;
+}
+
+inline void TaskGraph::depend(node_t node, node_t dependency)
+{
+	// only allowing edges to earlier nodes keeps the graph acyclic
+	if (node >= m_Nodes.size() || dependency >= node)
+	{
+		throw std::invalid_argument("TaskGraph dependencies must be added before their dependents");
+	}
+
+	m_Nodes[node]->dependencies.push_back(dependency);
+	m_Nodes[dependency]->dependents.push_back(node);
+}
+
+inline void TaskGraph::schedule(node_t node)
+{
+	auto worker = m_Nodes[node]->worker;
+	if (worker == any_worker)
+	{
+		m_Pool.submit(m_Counter, [this, node] { execute(node); });
+	}
+	else
+	{
+		m_Pool.submit_to(worker, m_Counter, [this, node] { execute(node); });
+	}
+}
+
+inline void TaskGraph::execute(node_t node_index)
+{
+	auto& node = *m_Nodes[node_index];
+
+	if (!node.failed)
+	{
+		auto start = clock_t::now();
+		try
+		{
+			node.func();
+		}
+		catch (...)
+		{
+			std::unique_lock<std::mutex> lock(m_ExceptionMutex);
+			if (!m_Exception)
+			{
+				m_Exception = std::current_exception();
+			}
+			node.failed = true;
+		}
+		auto end = clock_t::now();
+
+		node.lastStart = std::chrono::duration_cast<std::chrono::nanoseconds>(start - m_RunStart).count();
+		node.lastDuration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		node.totalDuration += node.lastDuration;
+		++node.runs;
+	}
+
+	for (auto dependent : node.dependents)
+	{
+		if (node.failed)
+		{
+			m_Nodes[dependent]->failed = true;
+		}
+
+		if (--m_Nodes[dependent]->remaining == 0)
+		{
+			schedule(dependent);
+		}
+	}
+}
+
+inline void TaskGraph::run()
+{
+	m_Exception = nullptr;
+	m_RunStart = clock_t::now();
+
+	// reset every node before the first one can complete and touch its dependents
+	for (auto& node : m_Nodes)
+	{
+		node->remaining = node->dependencies.size();
+		node->failed = false;
+	}
+
+	for (node_t node = 0; node < m_Nodes.size(); ++node)
+	{
+		if (m_Nodes[node]->dependencies.empty())
+		{
+			schedule(node);
+		}
+	}
+
+	m_Pool.wait(m_Counter);
+
+	if (m_Exception)
+	{
+		std::rethrow_exception(m_Exception);
+	}
+}
+
+inline std::string TaskGraph::MakeString(std::string separator) const
+{
+	std::stringstream ss;
+
+	//header
+	ss << "Node" << separator << "Dependencies" << separator << "Runs" << separator
+		<< "LastStart(ns)" << separator << "LastDuration(ns)" << separator << "MeanDuration(ns)" << "\n";
+
+	//data
+	for (auto& node : m_Nodes)
+	{
+		ss << node->name << separator;
+		for (size_t i = 0; i < node->dependencies.size(); ++i)
+		{
+			ss << (i > 0 ? " " : "") << m_Nodes[node->dependencies[i]]->name;
+		}
+		ss << separator << node->runs
+			<< separator << node->lastStart
+			<< separator << node->lastDuration
+			<< separator << (node->runs > 0 ? node->totalDuration / node->runs : 0) << "\n";
+	}
+
+	return ss.str();
+}
@@ -2,21 +2,42 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include "CpuTopology.h"
+#include "ThreadPool.h"
 
 struct TestConfiguration
 {
 	bool reuseCommandBuffers = false;
+	bool cacheCommandBuffers = false;	//<-- re-record a secondary buffer only when its range or render objects changed
 	size_t probeInterval = 0;	//make probes every frame. Interval is given in ms.
 	size_t seconds = 0;	//run until program is closed by user
 	bool exportCsv = false;
 	bool pipelineStatistics = false;
 	bool openHardwareMonitorData = false;
 	bool rotateCubes = false;
-	size_t drawThreadCount = 1;
+	size_t drawThreadCount = 0;	//<-- 0: derive from the CPU topology
 	size_t cubeDimension = 2;
 	int cubePadding = 1;
 	bool recordFPS = false;
 	bool recordFrameTime = false;
+	ThreadPlacement threadPlacement = ThreadPlacement::None;
+	int numaNode = -1;	//<-- -1: workers may use every NUMA node
+	std::vector<unsigned> threadCpus;	//<-- chosen placement: main thread first, then one per draw thread
+	WaitPolicy waitPolicy = WaitPolicy::Park;
+	size_t spinMicroseconds = 50;	//<-- how long idle draw threads spin before parking with WaitPolicy::SpinThenPark
+	QueueBackend queueBackend = QueueBackend::WorkStealing;
+	bool recordThreadStatistics = false;	//<-- per draw thread run, wait and idle time, sampled with the frame times
+	bool instanced = false;	//<-- one instanced draw per draw thread instead of one draw per render object
+	bool indirect = false;	//<-- draw threads write indirect draw commands, the primary buffer draws them
+	bool pushConstants = false;	//<-- per object draws push the model matrix instead of rebinding a dynamic uniform offset
+	size_t recordChunks = 1;	//<-- secondary buffers per draw thread, >1 lets idle threads pull the remaining chunks
+	bool balanceRecording = false;	//<-- move the object range boundaries towards equal recording times every frame
+	size_t framesInFlight = 2;	//<-- frames the CPU may be ahead of the GPU, 1 waits for every frame before starting the next
+	bool singleRenderPass = false;	//<-- skip the empty start pass, every frame clears and stores the attachments once
+	bool gpuTimestamps = false;	//<-- GPU time of every render pass and range, exported per frame
+	bool primaryPerThread = false;	//<-- every range is its own primary buffer with its own render pass, instead of a secondary
+	bool transformBenchmark = false;	//<-- only time the model matrix generation, write transformBenchmark.csv and exit
+	bool poolBenchmark = false;	//<-- only check and time the ThreadPool, write the pool*.csv files and exit
 
 	//TODO: use better pattern than singleton?
 	static TestConfiguration& GetInstance() 
@@ -31,6 +52,7 @@ struct TestConfiguration
 		
 		//data
 		ss << "Reuse CommandBuffers"	<< separator << force_string(reuseCommandBuffers)		<< "\n";
+		ss << "Cache CommandBuffers"	<< separator << force_string(cacheCommandBuffers)		<< "\n";
 		ss << "Probe Interval"			<< separator << force_string(probeInterval)				<< "\n";
 		ss << "Seconds"					<< separator << force_string(seconds)					<< "\n";
 		ss << "Export CSV"				<< separator << force_string(exportCsv)					<< "\n";
@@ -40,6 +62,24 @@ struct TestConfiguration
 		ss << "Draw Thread Count"		<< separator << force_string(drawThreadCount)			<< "\n";
 		ss << "Cube Dimension"			<< separator << force_string(cubeDimension)				<< "\n";
 		ss << "Cube Padding"			<< separator << force_string(cubePadding)				<< "\n";
+		ss << "Thread Placement"		<< separator << ToString(threadPlacement)				<< "\n";
+		ss << "NUMA Node"				<< separator << force_string(numaNode)					<< "\n";
+		ss << "Thread CPUs"				<< separator << join(threadCpus, " ")					<< "\n";
+		ss << "Wait Policy"				<< separator << ToString(waitPolicy)					<< "\n";
+		ss << "Spin Microseconds"		<< separator << force_string(spinMicroseconds)			<< "\n";
+		ss << "Queue Backend"			<< separator << ToString(queueBackend)					<< "\n";
+		ss << "Thread Statistics"		<< separator << force_string(recordThreadStatistics)	<< "\n";
+		ss << "Instanced"				<< separator << force_string(instanced)					<< "\n";
+		ss << "Indirect"				<< separator << force_string(indirect)					<< "\n";
+		ss << "Push Constants"			<< separator << force_string(pushConstants)				<< "\n";
+		ss << "Record Chunks"			<< separator << force_string(recordChunks)				<< "\n";
+		ss << "Balance Recording"		<< separator << force_string(balanceRecording)			<< "\n";
+		ss << "Frames In Flight"		<< separator << force_string(framesInFlight)			<< "\n";
+		ss << "Single Render Pass"		<< separator << force_string(singleRenderPass)			<< "\n";
+		ss << "GPU Timestamps"			<< separator << force_string(gpuTimestamps)				<< "\n";
+		ss << "Primary Per Thread"		<< separator << force_string(primaryPerThread)			<< "\n";
+		ss << "Transform Benchmark"		<< separator << force_string(transformBenchmark)		<< "\n";
+		ss << "Pool Benchmark"			<< separator << force_string(poolBenchmark)				<< "\n";
 
 		return ss.str();
 	}
@@ -85,6 +125,9 @@ struct TestConfiguration
 			else if (a == "-reuseComBuf") {
 				testConfig.reuseCommandBuffers = true;
 			}
+			else if (a == "-cacheComBuf") {
+				testConfig.cacheCommandBuffers = true;
+			}
 			else if (a == "-rotateCubes") {
 				testConfig.rotateCubes = true;
 			}
@@ -103,6 +146,57 @@ struct TestConfiguration
 			else if (a == "-frameTime") {
 				testConfig.recordFrameTime = true;
 			}
+			else if (a == "-threadPlacement") {
+				testConfig.threadPlacement = ParseThreadPlacement(args[i + 1]);
+			}
+			else if (a == "-numaNode") {
+				testConfig.numaNode = stoi(args[i + 1]);
+			}
+			else if (a == "-waitPolicy") {
+				testConfig.waitPolicy = ParseWaitPolicy(args[i + 1]);
+			}
+			else if (a == "-spinUs") {
+				testConfig.spinMicroseconds = stoi(args[i + 1]);
+			}
+			else if (a == "-queueBackend") {
+				testConfig.queueBackend = ParseQueueBackend(args[i + 1]);
+			}
+			else if (a == "-threadStats") {
+				testConfig.recordThreadStatistics = true;
+			}
+			else if (a == "-instanced") {
+				testConfig.instanced = true;
+			}
+			else if (a == "-indirect") {
+				testConfig.indirect = true;
+			}
+			else if (a == "-pushConstants") {
+				testConfig.pushConstants = true;
+			}
+			else if (a == "-recordChunks") {
+				testConfig.recordChunks = stoi(args[i + 1]);
+			}
+			else if (a == "-balance") {
+				testConfig.balanceRecording = true;
+			}
+			else if (a == "-framesInFlight") {
+				testConfig.framesInFlight = stoi(args[i + 1]);
+			}
+			else if (a == "-singlePass") {
+				testConfig.singleRenderPass = true;
+			}
+			else if (a == "-gpuTimestamps") {
+				testConfig.gpuTimestamps = true;
+			}
+			else if (a == "-primaryPerThread") {
+				testConfig.primaryPerThread = true;
+			}
+			else if (a == "-transformBenchmark") {
+				testConfig.transformBenchmark = true;
+			}
+			else if (a == "-poolBenchmark") {
+				testConfig.poolBenchmark = true;
+			}
 		}
 	}
 
@@ -122,4 +216,14 @@ private:
 	std::string force_string(bool arg) {
 		return arg ? "true" : "false";
 	}
+
+	template<typename T>
+	std::string join(const std::vector<T>& values, std::string separator)
+	{
+		std::stringstream ss;
+		for (auto i = 0; i < values.size(); ++i) {
+			ss << (i > 0 ? separator : "") << values[i];
+		}
+		return ss.str();
+	}
 };
\ No newline at end of file
@@ -1,104 +1,792 @@
 #pragma once
+#include <algorithm>
 #include <vector>
-#include <queue>
 #include <memory>
+#include <chrono>
+#include <string>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <condition_variable>
 #include <future>
 #include <functional>
 #include <stdexcept>
 
-using task_t = std::function<void()>;
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define THREADPOOL_CPU_RELAX() _mm_pause()
+#else
+#define THREADPOOL_CPU_RELAX() std::this_thread::yield()
+#endif
 
+#include "CpuTopology.h"
+#include "InlineTask.h"
+#include "MpmcQueue.h"
+
+using task_t = InlineTask;
+
+// What an idle worker does while waiting for its next task.
+enum class WaitPolicy
+{
+	Park,			//<-- block on the condition variable right away
+	SpinThenPark	//<-- spin with backoff for the spin time, then block
+};
+
+inline const char* ToString(WaitPolicy policy)
+{
+	return policy == WaitPolicy::SpinThenPark ? "spin" : "park";
+}
+
+inline WaitPolicy ParseWaitPolicy(const std::string& name)
+{
+	if (name == "spin") {
+		return WaitPolicy::SpinThenPark;
+	}
+	if (name == "park") {
+		return WaitPolicy::Park;
+	}
+	throw std::runtime_error("Unknown wait policy: " + name);
+}
+
+// Time from a task being pushed until an idle worker started it, per worker.
+struct WakeupStatistics
+{
+	uint64_t wakeups = 0;
+	uint64_t totalNanoseconds = 0;
+	uint64_t maxNanoseconds = 0;
+};
+
+// How frame tasks are queued, fixed at construction.
+enum class QueueBackend
+{
+	WorkStealing,	//<-- one mutex guarded ring per worker, idle workers steal
+	LockFree		//<-- one shared lock-free bounded MPMC ring (see MpmcQueue)
+};
+
+inline const char* ToString(QueueBackend backend)
+{
+	return backend == QueueBackend::LockFree ? "mpmc" : "steal";
+}
+
+inline QueueBackend ParseQueueBackend(const std::string& name)
+{
+	if (name == "mpmc") {
+		return QueueBackend::LockFree;
+	}
+	if (name == "steal") {
+		return QueueBackend::WorkStealing;
+	}
+	throw std::runtime_error("Unknown queue backend: " + name);
+}
+
+// Lane a task is queued in. Frame tasks run on the workers, background tasks on the pool's background thread.
+enum class TaskPriority
+{
+	Frame,		//<-- work the current or next frame waits for, e.g. recording command buffers
+	Background	//<-- everything else, e.g. telemetry or asset loading
+};
+
+// Where a worker spent its time, see ThreadPool::set_statistics_enabled. Times in ns.
+struct WorkerStatistics
+{
+	uint64_t tasks = 0;				//<-- tasks executed by the worker
+	uint64_t runNanoseconds = 0;	//<-- executing tasks
+	uint64_t waitNanoseconds = 0;	//<-- searching, spinning and yielding until the next task was found
+	uint64_t idleNanoseconds = 0;	//<-- parked on the condition variable
+	uint64_t contentions = 0;		//<-- times the worker's ring was already locked by another thread
+
+	WorkerStatistics operator-(const WorkerStatistics& rhs) const
+	{
+		WorkerStatistics result;
+		result.tasks = tasks - rhs.tasks;
+		result.runNanoseconds = runNanoseconds - rhs.runNanoseconds;
+		result.waitNanoseconds = waitNanoseconds - rhs.waitNanoseconds;
+		result.idleNanoseconds = idleNanoseconds - rhs.idleNanoseconds;
+		result.contentions = contentions - rhs.contentions;
+		return result;
+	}
+};
+
+/*
+ * Tracks completion of tasks handed to ThreadPool::submit.
+ * A plain atomic counter instead of a future per task; wait on it with ThreadPool::wait.
+ * It is reusable: once done, the same counter can serve as the barrier for the next frame.
+ */
+class TaskCounter
+{
+public:
+	TaskCounter() : m_Pending(0) { }
+	TaskCounter(const TaskCounter&) = delete;
+	TaskCounter& operator=(const TaskCounter&) = delete;
+
+	bool done() const { return m_Pending == 0; }
+private:
+	friend class ThreadPool;
+	std::atomic<size_t> m_Pending;
+};
+
+/*
+ * Work-stealing thread pool.
+ * Every worker owns a fixed-size ring of tasks guarded by its own mutex. A worker pops from the back
+ * of its own ring and, when that is empty, steals from the front of the other workers' rings. Tasks
+ * enqueued from a worker go to that worker's ring, tasks enqueued from outside the pool are spread
+ * round robin, so submitters and workers rarely touch the same lock.
+ *
+ * enqueue returns a std::future and allocates for it. submit stores the task inline in a ring slot and
+ * signals a TaskCounter, so it never touches the allocator; use it for per-frame work.
+ *
+ * Idle workers either park right away or spin for a while first (see WaitPolicy). Spinning burns CPU
+ * between frames but saves the futex wake and scheduler hop when the next frame's tasks arrive.
+ *
+ * With QueueBackend::LockFree the per-worker rings are replaced by one shared MpmcQueue, everything else
+ * (parking, priorities, statistics) stays the same. Lock contention is not counted for it.
+ *
+ * submit_to hands a task to one specific worker. Such tasks sit in a separate ring of that worker that nobody
+ * else pops from, so per-thread resources (e.g. a VkCommandPool) are always used by the same OS thread.
+ * Workers look at their pinned ring before anything else, also while they wait for a TaskCounter.
+ *
+ * Background tasks (see TaskPriority) go to a separate FIFO that only the pool's background thread runs, one
+ * at a time in submission order. Workers and threads waiting in wait or parallel_for never pick them up, so a
+ * slow background task (e.g. a WMI query) never holds a worker that frame tasks, pinned ones included, are
+ * waiting for. The background thread is not a worker: it isn't pinned, isn't in thread_count and has no
+ * statistics. Frame load can't starve it either, the OS schedules it like any other thread.
+ */
 class ThreadPool
 {
+	static const size_t s_WorkerCapacity = 1024;	//<-- task slots per worker
+	static const size_t s_BackgroundCapacity = 1024;	//<-- task slots of the background lane
+
+	using clock_t = std::chrono::steady_clock;
+
+	struct QueuedTask
+	{
+		task_t task;
+		clock_t::time_point pushed;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::unique_ptr<QueuedTask[]> slots{ new QueuedTask[s_WorkerCapacity] };
+		size_t head = 0;	//<-- oldest task, stolen by other workers
+		size_t tail = 0;	//<-- one past the newest task, popped by the owner
+
+		// tasks only this worker may run (submit_to), FIFO, guarded by the same mutex
+		std::unique_ptr<QueuedTask[]> pinned{ new QueuedTask[s_WorkerCapacity] };
+		size_t pinnedHead = 0;
+		size_t pinnedTail = 0;
+		std::atomic<size_t> pinnedPending{ 0 };
+
+		// only written by the worker itself
+		std::atomic<uint64_t> wakeups{ 0 };
+		std::atomic<uint64_t> wakeupNanoseconds{ 0 };
+		std::atomic<uint64_t> maxWakeupNanoseconds{ 0 };
+		std::atomic<uint64_t> tasks{ 0 };
+		std::atomic<uint64_t> runNanoseconds{ 0 };
+		std::atomic<uint64_t> waitNanoseconds{ 0 };
+		std::atomic<uint64_t> idleNanoseconds{ 0 };
+
+		std::atomic<uint64_t> contentions{ 0 };	//<-- written by whoever found the ring locked
+
+		size_t size() const { return tail - head; }
+	};
+
 	std::vector<std::thread> m_Threads;
-	std::queue<task_t> m_Tasks;
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::vector<unsigned> m_Affinity;	//<-- logical processor of each worker, empty when workers are not pinned
+
+	QueueBackend m_Backend;
+	std::unique_ptr<MpmcQueue<QueuedTask>> m_SharedQueue;	//<-- only with QueueBackend::LockFree
+
+	std::atomic<size_t> m_NextWorker;	//<-- round robin index for submissions from outside the pool
+	std::atomic<size_t> m_PendingTasks;	//<-- frame tasks pushed but not yet popped
 
-	std::mutex m_QueueMutex;
+	// Background lane, drained by m_BackgroundThread only
+	std::thread m_BackgroundThread;
+	std::mutex m_BackgroundMutex;
+	std::condition_variable m_BackgroundCondition;
+	std::unique_ptr<task_t[]> m_BackgroundSlots;
+	size_t m_BackgroundHead;
+	size_t m_BackgroundTail;
+
+	// Only used to park idle workers. Submitters lock it only when someone is sleeping.
+	std::mutex m_SleepMutex;
 	std::condition_variable m_ConditionVariable;
-	bool stopped = false;
+	std::atomic<size_t> m_SleepingThreads;
+
+	std::atomic<WaitPolicy> m_WaitPolicy;
+	std::atomic<int64_t> m_SpinNanoseconds;
+
+	std::atomic_bool m_Statistics;	//<-- off: no clock reads or counter updates beyond the wakeup latency
+
+	std::atomic_bool stopped;
 	std::atomic_int active_threads;
 public:
-	ThreadPool(size_t thread_count);
+	// affinity holds one logical processor per worker (see CpuTopology::placement), or nothing to let the OS decide.
+	ThreadPool(size_t thread_count, std::vector<unsigned> affinity = {}, QueueBackend backend = QueueBackend::WorkStealing);
 	ThreadPool(const ThreadPool&) = delete; // No copying
 	~ThreadPool() noexcept;
 
 	template<class TFunc, class... TArgs>
 	auto enqueue(TFunc&&, TArgs&&...)->std::future<typename std::result_of<TFunc(TArgs...)>::type>;
 
+	// Allocation free submission. func must fit in an InlineTask together with a pointer to counter, and must not throw.
+	template<class TFunc>
+	void submit(TaskCounter& counter, TFunc&& func, TaskPriority priority = TaskPriority::Frame);
+
+	// Like submit, but only worker worker_index (0 <= worker_index < thread_count) will run func.
+	// Blocks while that worker's pinned ring is full.
+	template<class TFunc>
+	void submit_to(size_t worker_index, TaskCounter& counter, TFunc&& func);
+
+	// Runs pending frame tasks on the calling thread until every task submitted against counter has finished.
+	// A worker also runs the tasks pinned to itself, so a pinned task may wait for work pinned to its own worker.
+	// Background tasks are left to the background thread, tasks pinned to other workers to those workers.
+	void wait(const TaskCounter& counter);
+
+	// Calls func(chunkBegin, chunkEnd) for consecutive chunks of at most grain indices covering [begin, end).
+	// The calling thread works on chunks too and returns once all of them are done. func must not throw.
+	template<class TFunc>
+	void parallel_for(size_t begin, size_t end, size_t grain, TFunc&& func);
+
+	size_t thread_count() const { return m_Threads.size(); }
+	// Index of the calling worker (for submit_to), thread_count() on threads that aren't workers of this pool.
+	size_t worker_index() const;
+	QueueBackend queue_backend() const { return m_Backend; }
+
+	// Can be changed while the pool is running; idle workers pick it up on their next wait.
+	void set_wait_policy(WaitPolicy policy, std::chrono::microseconds spin_time = std::chrono::microseconds(50));
+
+	std::vector<WakeupStatistics> wakeup_statistics() const;
+
+	// Per-worker time accounting. Off by default; when off the workers skip the extra clock reads.
+	// The counters only grow, take the difference of two snapshots for an interval (e.g. a frame).
+	// Tasks run by non-worker threads inside wait or parallel_for are not counted.
+	void set_statistics_enabled(bool enabled) { m_Statistics = enabled; }
+	bool statistics_enabled() const { return m_Statistics; }
+	std::vector<WorkerStatistics> worker_statistics() const;
+
 	ThreadPool operator=(const ThreadPool&) = delete; // No assigning
 
 private:
-	template<class result_t>
-	void inner_enqueue(std::shared_ptr<std::packaged_task<result_t()>> task);
-	task_t get_next_task();
-	void thread_function();
-	bool task_ready();
+	struct WorkerContext
+	{
+		const ThreadPool* pool = nullptr;
+		size_t index = 0;
+	};
+	static WorkerContext& current_worker();
+
+	void push(task_t&& task, TaskPriority priority = TaskPriority::Frame);
+	void push_background(task_t&& task);
+	void push_shared(task_t&& task);
+	void push_pinned(size_t worker_index, task_t&& task);
+	bool try_pop_pinned(Worker& worker, QueuedTask& task);
+	bool try_pop_shared(QueuedTask& task);
+	bool try_pop(size_t worker_index, QueuedTask& task);
+	bool try_steal(size_t worker_index, QueuedTask& task);
+	bool try_run_one();
+	void wait_for_task(const Worker& worker);
+	bool spin(clock_t::time_point idle_since, unsigned& backoff) const;
+	void record_wakeup(Worker& worker, clock_t::time_point pushed);
+	static void add(std::atomic<uint64_t>& counter, uint64_t value);
+	std::unique_lock<std::mutex> lock_worker(Worker& worker);
+	void notify(bool all = false);
+	void thread_function(size_t worker_index);
+	void background_function();
+	bool task_ready(const Worker& worker) const;
 	void stop();
 };
 
-inline bool ThreadPool::task_ready()
+inline ThreadPool::WorkerContext& ThreadPool::current_worker()
 {
-	return stopped || !m_Tasks.empty();
+	thread_local WorkerContext context;
+	return context;
+}
+
+inline bool ThreadPool::task_ready(const Worker& worker) const
+{
+	return stopped || m_PendingTasks > 0 || worker.pinnedPending > 0;
 }
 
 inline void ThreadPool::stop()
 {
-	std::unique_lock<std::mutex> lock(m_QueueMutex);
+	std::unique_lock<std::mutex> lock(m_SleepMutex);
 	stopped = true;
 }
 
-inline task_t ThreadPool::get_next_task()
+inline void ThreadPool::push(task_t&& task, TaskPriority priority)
 {
-	std::unique_lock<std::mutex> lock(m_QueueMutex);
-	m_ConditionVariable.wait(lock, [this] {return this->task_ready();});
-	if (stopped && m_Tasks.empty())
+	// don't allow enqueueing after stopping the pool
+	if (stopped)
 	{
-		return [] {}; // Return empty task
+		throw std::runtime_error("Tried to enqueue task on stopped ThreadPool");
 	}
-	auto result = std::move(m_Tasks.front());
-	m_Tasks.pop();
-	++active_threads;
-	return std::move(result);
-}
 
-inline void ThreadPool::thread_function()
-{
-	while (!stopped)
+	if (priority == TaskPriority::Background)
+	{
+		push_background(std::move(task));
+		return;
+	}
+
+	if (m_SharedQueue)
+	{
+		push_shared(std::move(task));
+		return;
+	}
+
+	// workers keep their own tasks local, everyone else is spread over the workers
+	auto& context = current_worker();
+	auto index = context.pool == this
+		? context.index
+		: m_NextWorker.fetch_add(1) % m_Workers.size();
+
+	auto& worker = *m_Workers[index];
+	{
+		auto lock = lock_worker(worker);
+		if (worker.size() < s_WorkerCapacity)
+		{
+			auto& slot = worker.slots[worker.tail % s_WorkerCapacity];
+			slot.task = std::move(task);
+			slot.pushed = clock_t::now();
+			++worker.tail;
+			++m_PendingTasks;
+		}
+	}
+
+	// the ring is full: run the task right here rather than growing the ring
+	if (task)
 	{
-		auto task = get_next_task();
 		task();
-		--active_threads;
+		task.reset();
+		return;
 	}
+
+	notify();
 }
 
-inline ThreadPool::ThreadPool(size_t thread_count)
+inline void ThreadPool::push_background(task_t&& task)
 {
-	for (int i = 0; i < thread_count; ++i)
 	{
-		m_Threads.emplace_back(
-			[this]
+		std::unique_lock<std::mutex> lock(m_BackgroundMutex);
+		if (m_BackgroundTail - m_BackgroundHead < s_BackgroundCapacity)
 		{
-			this->thread_function();
+			m_BackgroundSlots[m_BackgroundTail % s_BackgroundCapacity] = std::move(task);
+			++m_BackgroundTail;
 		}
-		);
 	}
+
+	// the lane is full: the producer of the background work pays for it
+	if (task)
+	{
+		task();
+		task.reset();
+		return;
+	}
+
+	m_BackgroundCondition.notify_one();
+}
+
+inline void ThreadPool::push_shared(task_t&& task)
+{
+	QueuedTask queued;
+	queued.task = std::move(task);
+	queued.pushed = clock_t::now();
+
+	// counted before it becomes visible, so m_PendingTasks never drops below the number of queued tasks
+	++m_PendingTasks;
+	if (!m_SharedQueue->try_push(std::move(queued)))
+	{
+		// the ring is full: run the task right here rather than growing the ring
+		--m_PendingTasks;
+		queued.task();
+		return;
+	}
+
+	notify();
 }
 
-template<class result_t>
-inline void ThreadPool::inner_enqueue(std::shared_ptr<std::packaged_task<result_t()>> task)
+inline bool ThreadPool::try_pop_shared(QueuedTask& task)
 {
-	std::unique_lock<std::mutex> lock(m_QueueMutex);
+	if (!m_SharedQueue->try_pop(task))
+	{
+		return false;
+	}
 
-	// don't allow enqueueing after stopping the pool
+	--m_PendingTasks;
+	return true;
+}
+
+inline void ThreadPool::push_pinned(size_t worker_index, task_t&& task)
+{
 	if (stopped)
 	{
 		throw std::runtime_error("Tried to enqueue task on stopped ThreadPool");
 	}
 
-	m_Tasks.emplace([task]() { (*task)(); });
+	if (worker_index >= m_Workers.size())
+	{
+		throw std::out_of_range("ThreadPool has no worker " + std::to_string(worker_index));
+	}
+
+	auto& worker = *m_Workers[worker_index];
+	while (true)
+	{
+		{
+			auto lock = lock_worker(worker);
+			if (worker.pinnedTail - worker.pinnedHead < s_WorkerCapacity)
+			{
+				auto& slot = worker.pinned[worker.pinnedTail % s_WorkerCapacity];
+				slot.task = std::move(task);
+				slot.pushed = clock_t::now();
+				++worker.pinnedTail;
+				++worker.pinnedPending;
+				break;
+			}
+		}
+
+		// the ring is full: the owner may run the task itself, anyone else waits for the owner to catch up
+		auto& context = current_worker();
+		if (context.pool == this && context.index == worker_index)
+		{
+			task();
+			task.reset();
+			return;
+		}
+		std::this_thread::yield();
+	}
+
+	// the shared condition variable can't address one worker, so wake everyone and let the owner take it
+	notify(true);
+}
+
+inline bool ThreadPool::try_pop_pinned(Worker& worker, QueuedTask& task)
+{
+	if (worker.pinnedPending == 0)
+	{
+		return false;
+	}
+
+	auto lock = lock_worker(worker);
+	if (worker.pinnedTail == worker.pinnedHead)
+	{
+		return false;
+	}
+
+	task = std::move(worker.pinned[worker.pinnedHead % s_WorkerCapacity]);
+	++worker.pinnedHead;
+	--worker.pinnedPending;
+	return true;
+}
+
+inline bool ThreadPool::try_pop(size_t worker_index, QueuedTask& task)
+{
+	if (m_SharedQueue)
+	{
+		return try_pop_shared(task);
+	}
+
+	auto& worker = *m_Workers[worker_index];
+	auto lock = lock_worker(worker);
+	if (worker.size() == 0)
+	{
+		return false;
+	}
+
+	--worker.tail;
+	task = std::move(worker.slots[worker.tail % s_WorkerCapacity]);
+	--m_PendingTasks;
+	return true;
+}
+
+inline bool ThreadPool::try_steal(size_t worker_index, QueuedTask& task)
+{
+	// there is nothing to steal from a shared queue, try_pop already looked at it
+	if (m_SharedQueue)
+	{
+		return false;
+	}
+
+	for (size_t i = 1; i < m_Workers.size(); ++i)
+	{
+		auto& victim = *m_Workers[(worker_index + i) % m_Workers.size()];
+
+		// don't queue up behind a busy victim, just move on to the next one
+		std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+		if (!lock.owns_lock())
+		{
+			if (m_Statistics)
+			{
+				victim.contentions.fetch_add(1, std::memory_order_relaxed);
+			}
+			continue;
+		}
+
+		if (victim.size() == 0)
+		{
+			continue;
+		}
+
+		task = std::move(victim.slots[victim.head % s_WorkerCapacity]);
+		++victim.head;
+		--m_PendingTasks;
+		return true;
+	}
+	return false;
+}
+
+inline size_t ThreadPool::worker_index() const
+{
+	auto& context = current_worker();
+	return context.pool == this ? context.index : thread_count();
+}
+
+inline bool ThreadPool::try_run_one()
+{
+	auto& context = current_worker();
+	auto index = context.pool == this ? context.index : 0;
+
+	// workers start with their pinned and their own ring, other threads just take whatever they find
+	QueuedTask task;
+	auto found = context.pool == this
+		? try_pop_pinned(*m_Workers[index], task) || try_pop(index, task) || try_steal(index, task)
+		: try_steal(index, task) || try_pop(index, task);
+	if (found)
+	{
+		task.task();
+		return true;
+	}
+	return false;
+}
+
+inline void ThreadPool::wait_for_task(const Worker& worker)
+{
+	std::unique_lock<std::mutex> lock(m_SleepMutex);
+	++m_SleepingThreads;
+	m_ConditionVariable.wait(lock, [this, &worker] {return this->task_ready(worker);});
+	--m_SleepingThreads;
+}
+
+inline bool ThreadPool::spin(clock_t::time_point idle_since, unsigned& backoff) const
+{
+	if (m_WaitPolicy != WaitPolicy::SpinThenPark || clock_t::now() - idle_since >= std::chrono::nanoseconds(m_SpinNanoseconds.load()))
+	{
+		return false;
+	}
+
+	// exponential backoff keeps the spinning worker off the shared cache lines
+	for (unsigned i = 0; i < backoff; ++i)
+	{
+		THREADPOOL_CPU_RELAX();
+	}
+	backoff = std::min(backoff * 2, 64u);
+	return true;
+}
+
+inline void ThreadPool::record_wakeup(Worker& worker, clock_t::time_point pushed)
+{
+	auto latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - pushed).count());
+	add(worker.wakeups, 1);
+	add(worker.wakeupNanoseconds, latency);
+	if (latency > worker.maxWakeupNanoseconds.load(std::memory_order_relaxed))
+	{
+		worker.maxWakeupNanoseconds.store(latency, std::memory_order_relaxed);
+	}
+}
+
+inline void ThreadPool::add(std::atomic<uint64_t>& counter, uint64_t value)
+{
+	// single writer, so a plain load and store is enough and avoids a locked instruction
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline std::unique_lock<std::mutex> ThreadPool::lock_worker(Worker& worker)
+{
+	if (!m_Statistics)
+	{
+		return std::unique_lock<std::mutex>(worker.mutex);
+	}
+
+	// try first so a held lock is counted before blocking on it
+	std::unique_lock<std::mutex> lock(worker.mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		worker.contentions.fetch_add(1, std::memory_order_relaxed);
+		lock.lock();
+	}
+	return lock;
+}
+
+inline void ThreadPool::notify(bool all)
+{
+	// m_PendingTasks is incremented before m_SleepingThreads is read, and a sleeper increments
+	// m_SleepingThreads before checking m_PendingTasks, so either we see the sleeper or it sees the task.
+	if (m_SleepingThreads > 0)
+	{
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		if (all)
+		{
+			m_ConditionVariable.notify_all();
+		}
+		else
+		{
+			m_ConditionVariable.notify_one();
+		}
+	}
+}
+
+inline void ThreadPool::thread_function(size_t worker_index)
+{
+	auto& context = current_worker();
+	context.pool = this;
+	context.index = worker_index;
+
+	if (!m_Affinity.empty())
+	{
+		CpuTopology::PinCurrentThread(m_Affinity[worker_index]);
+	}
+
+	auto& worker = *m_Workers[worker_index];
+	auto idle = false;
+	auto idleSince = clock_t::now();
+	int64_t parkedNanoseconds = 0;	//<-- part of the current idle period spent parked
+	unsigned backoff = 1;
+
+	QueuedTask task;
+	while (true)
+	{
+		if (try_pop_pinned(worker, task) || try_pop(worker_index, task) || try_steal(worker_index, task))
+		{
+			// only the first task after an idle period says anything about wakeup latency
+			if (idle)
+			{
+				record_wakeup(worker, task.pushed);
+				idle = false;
+
+				if (m_Statistics)
+				{
+					auto idleNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - idleSince).count();
+					add(worker.waitNanoseconds, static_cast<uint64_t>(std::max<int64_t>(idleNanoseconds - parkedNanoseconds, 0)));
+				}
+			}
+
+			++active_threads;
+			if (m_Statistics)
+			{
+				auto start = clock_t::now();
+				task.task();
+				add(worker.runNanoseconds, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count()));
+				add(worker.tasks, 1);
+			}
+			else
+			{
+				task.task();
+			}
+			task.task.reset();
+			--active_threads;
+			continue;
+		}
+
+		// a steal may have failed on a busy lock, so only give up when nothing is pending
+		if (stopped && m_PendingTasks == 0 && worker.pinnedPending == 0)
+		{
+			return;
+		}
+
+		if (!idle)
+		{
+			idle = true;
+			idleSince = clock_t::now();
+			parkedNanoseconds = 0;
+			backoff = 1;
+		}
+
+		if (m_PendingTasks > 0 || worker.pinnedPending > 0)
+		{
+			std::this_thread::yield();
+		}
+		else if (!spin(idleSince, backoff))
+		{
+			if (m_Statistics)
+			{
+				auto start = clock_t::now();
+				wait_for_task(worker);
+				auto parked = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_t::now() - start).count();
+				parkedNanoseconds += parked;
+				add(worker.idleNanoseconds, static_cast<uint64_t>(parked));
+			}
+			else
+			{
+				wait_for_task(worker);
+			}
+		}
+	}
+}
+
+inline void ThreadPool::background_function()
+{
+	task_t task;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_BackgroundMutex);
+			m_BackgroundCondition.wait(lock, [this] { return stopped || m_BackgroundTail != m_BackgroundHead; });
+
+			// what was queued before the pool stopped still runs
+			if (m_BackgroundTail == m_BackgroundHead)
+			{
+				return;
+			}
+			task = std::move(m_BackgroundSlots[m_BackgroundHead % s_BackgroundCapacity]);
+			++m_BackgroundHead;
+		}
+
+		task();
+		task.reset();
+	}
+}
+
+inline ThreadPool::ThreadPool(size_t thread_count, std::vector<unsigned> affinity, QueueBackend backend)
+	: m_Affinity(std::move(affinity)), m_Backend(backend), m_NextWorker(0), m_PendingTasks(0),
+	  m_BackgroundSlots(new task_t[s_BackgroundCapacity]), m_BackgroundHead(0), m_BackgroundTail(0), m_SleepingThreads(0),
+	  m_WaitPolicy(WaitPolicy::Park), m_SpinNanoseconds(0), m_Statistics(false), stopped(false), active_threads(0)
+{
+	if (thread_count == 0)
+	{
+		throw std::invalid_argument("ThreadPool needs at least one thread");
+	}
+
+	if (!m_Affinity.empty() && m_Affinity.size() != thread_count)
+	{
+		throw std::invalid_argument("ThreadPool affinity needs one logical processor per thread");
+	}
+
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		m_Workers.push_back(std::make_unique<Worker>());
+	}
+
+	if (m_Backend == QueueBackend::LockFree)
+	{
+		// same total capacity as the per-worker rings, rounded up to a power of two
+		size_t capacity = 2;
+		while (capacity < s_WorkerCapacity * thread_count)
+		{
+			capacity *= 2;
+		}
+		m_SharedQueue = std::make_unique<MpmcQueue<QueuedTask>>(capacity);
+	}
+
+	for (size_t i = 0; i < thread_count; ++i)
+	{
+		m_Threads.emplace_back(
+			[this, i]
+		{
+			this->thread_function(i);
+		}
+		);
+	}
+
+	m_BackgroundThread = std::thread([this] { background_function(); });
 }
 
 template<class TFunc, class... TArgs>
@@ -110,10 +798,125 @@ inline auto ThreadPool::enqueue(TFunc&& func, TArgs&&... args)
 	auto task = std::make_shared<std::packaged_task<result_t()>>(
 		std::bind(std::forward<TFunc>(func), std::forward<TArgs>(args)...)
 		);
-	inner_enqueue(task);
 	auto result = task->get_future();
 
-	m_ConditionVariable.notify_one();
+	push([task]() { (*task)(); });
+	return result;
+}
+
+template<class TFunc>
+inline void ThreadPool::submit(TaskCounter& counter, TFunc&& func, TaskPriority priority)
+{
+	++counter.m_Pending;
+	push([&counter, func]() mutable
+	{
+		func();
+		--counter.m_Pending;
+	}, priority);
+}
+
+template<class TFunc>
+inline void ThreadPool::submit_to(size_t worker_index, TaskCounter& counter, TFunc&& func)
+{
+	++counter.m_Pending;
+	push_pinned(worker_index, [&counter, func]() mutable
+	{
+		func();
+		--counter.m_Pending;
+	});
+}
+
+inline void ThreadPool::wait(const TaskCounter& counter)
+{
+	while (!counter.done())
+	{
+		if (!try_run_one())
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+template<class TFunc>
+inline void ThreadPool::parallel_for(size_t begin, size_t end, size_t grain, TFunc&& func)
+{
+	if (begin >= end)
+	{
+		return;
+	}
+	grain = std::max<size_t>(grain, 1);
+
+	// chunks are handed out from a shared counter, so fast threads simply take more of them
+	struct Range
+	{
+		std::atomic<size_t> next;
+		size_t end;
+		size_t grain;
+		typename std::remove_reference<TFunc>::type* func;
+
+		void run()
+		{
+			for (auto first = next.fetch_add(grain); first < end; first = next.fetch_add(grain))
+			{
+				(*func)(first, std::min(first + grain, end));
+			}
+		}
+	};
+
+	Range range;
+	range.next = begin;
+	range.end = end;
+	range.grain = grain;
+	range.func = &func;
+
+	// the calling thread takes one share of the work itself
+	auto chunkCount = (end - begin + grain - 1) / grain;
+	auto helperCount = std::min(chunkCount - 1, thread_count());
+
+	TaskCounter barrier;
+	auto rangePtr = &range;
+	for (size_t i = 0; i < helperCount; ++i)
+	{
+		submit(barrier, [rangePtr] { rangePtr->run(); });
+	}
+
+	range.run();
+	wait(barrier);
+}
+
+inline void ThreadPool::set_wait_policy(WaitPolicy policy, std::chrono::microseconds spin_time)
+{
+	m_SpinNanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(spin_time).count();
+	m_WaitPolicy = policy;
+}
+
+inline std::vector<WakeupStatistics> ThreadPool::wakeup_statistics() const
+{
+	std::vector<WakeupStatistics> result;
+	for (auto& worker : m_Workers)
+	{
+		WakeupStatistics statistics;
+		statistics.wakeups = worker->wakeups;
+		statistics.totalNanoseconds = worker->wakeupNanoseconds;
+		statistics.maxNanoseconds = worker->maxWakeupNanoseconds;
+		result.push_back(statistics);
+	}
+	return result;
+}
+
+inline std::vector<WorkerStatistics> ThreadPool::worker_statistics() const
+{
+	std::vector<WorkerStatistics> result;
+	for (auto& worker : m_Workers)
+	{
+		WorkerStatistics statistics;
+		statistics.tasks = worker->tasks.load(std::memory_order_relaxed);
+		statistics.runNanoseconds = worker->runNanoseconds.load(std::memory_order_relaxed);
+		statistics.waitNanoseconds = worker->waitNanoseconds.load(std::memory_order_relaxed);
+		statistics.idleNanoseconds = worker->idleNanoseconds.load(std::memory_order_relaxed);
+		statistics.contentions = worker->contentions.load(std::memory_order_relaxed);
+		result.push_back(statistics);
+	}
 	return result;
 }
 
@@ -125,4 +928,11 @@ inline ThreadPool::~ThreadPool() noexcept
 	{
 		thread.join();
 	}
+
+	// taking the lock orders stopped before the background thread's next look at it, so the wakeup isn't lost
+	{
+		std::unique_lock<std::mutex> lock(m_BackgroundMutex);
+	}
+	m_BackgroundCondition.notify_all();
+	m_BackgroundThread.join();
 }
@@ -0,0 +1,133 @@
+#include "TransformStore.h"
+
+#include <array>
+#include <cmath>
+#include <xmmintrin.h>
+
+namespace
+{
+	const size_t batchSize = 4;	//<-- objects per SSE register
+
+	// the angles are whole degrees, so sine and cosine come from a table instead of being computed per object
+	struct AngleTable
+	{
+		std::array<float, 360> sin;
+		std::array<float, 360> cos;
+
+		AngleTable()
+		{
+			for (auto degrees = 0; degrees < 360; ++degrees) {
+				auto radians = degrees * 3.14159268 / 180;
+				sin[degrees] = static_cast<float>(std::sin(radians));
+				cos[degrees] = static_cast<float>(std::cos(radians));
+			}
+		}
+	};
+
+	const AngleTable& angleTable()
+	{
+		static const AngleTable table;
+		return table;
+	}
+}
+
+TransformStore::TransformStore(const std::vector<RenderObject>& renderObjects)
+{
+	auto count = renderObjects.size();
+	m_X.reserve(count);
+	m_Y.reserve(count);
+	m_Z.reserve(count);
+	m_AxisX.reserve(count);
+	m_AxisY.reserve(count);
+	m_AxisZ.reserve(count);
+	m_Angles.assign(count, 0);
+
+	for (size_t index = 0; index < count; ++index) {
+		auto& renderObject = renderObjects[index];
+		m_X.push_back(renderObject.x());
+		m_Y.push_back(renderObject.y());
+		m_Z.push_back(renderObject.z());
+
+		//every object spins around (1, 2, 3), alternating the direction
+		auto sign = index % 2 == 0 ? 1.0f : -1.0f;
+		auto length = std::sqrt(1.0f + 4.0f + 9.0f);
+		m_AxisX.push_back(sign * 1.0f / length);
+		m_AxisY.push_back(sign * 2.0f / length);
+		m_AxisZ.push_back(sign * 3.0f / length);
+	}
+}
+
+void TransformStore::update(size_t first, size_t last, uint8_t* destination, size_t stride, bool rotate)
+{
+	auto& table = angleTable();
+	auto index = first;
+
+	for (; index + batchSize <= last; index += batchSize) {
+		alignas(16) float sin[batchSize];
+		alignas(16) float cos[batchSize];
+		for (size_t lane = 0; lane < batchSize; ++lane) {
+			auto& angle = m_Angles[index + lane];
+			angle = angle == 359 ? 0 : angle + 1;
+			sin[lane] = rotate ? table.sin[angle] : 0.0f;
+			cos[lane] = rotate ? table.cos[angle] : 1.0f;
+		}
+
+		auto s = _mm_load_ps(sin);
+		auto c = _mm_load_ps(cos);
+		auto ax = _mm_loadu_ps(&m_AxisX[index]);
+		auto ay = _mm_loadu_ps(&m_AxisY[index]);
+		auto az = _mm_loadu_ps(&m_AxisZ[index]);
+
+		//the rotation of glm::rotate, one object per lane
+		auto t = _mm_sub_ps(_mm_set1_ps(1.0f), c);
+		auto tx = _mm_mul_ps(t, ax);
+		auto ty = _mm_mul_ps(t, ay);
+		auto tz = _mm_mul_ps(t, az);
+		auto sx = _mm_mul_ps(s, ax);
+		auto sy = _mm_mul_ps(s, ay);
+		auto sz = _mm_mul_ps(s, az);
+
+		__m128 columns[4][4] = {
+			{ _mm_add_ps(c, _mm_mul_ps(tx, ax)), _mm_add_ps(_mm_mul_ps(tx, ay), sz), _mm_sub_ps(_mm_mul_ps(tx, az), sy), _mm_setzero_ps() },
+			{ _mm_sub_ps(_mm_mul_ps(ty, ax), sz), _mm_add_ps(c, _mm_mul_ps(ty, ay)), _mm_add_ps(_mm_mul_ps(ty, az), sx), _mm_setzero_ps() },
+			{ _mm_add_ps(_mm_mul_ps(tz, ax), sy), _mm_sub_ps(_mm_mul_ps(tz, ay), sx), _mm_add_ps(c, _mm_mul_ps(tz, az)), _mm_setzero_ps() },
+			{ _mm_loadu_ps(&m_X[index]), _mm_loadu_ps(&m_Y[index]), _mm_loadu_ps(&m_Z[index]), _mm_set1_ps(1.0f) }
+		};
+
+		//from one component of four objects per register to one column of one object per register
+		for (auto& column : columns) {
+			_MM_TRANSPOSE4_PS(column[0], column[1], column[2], column[3]);
+		}
+
+		for (size_t lane = 0; lane < batchSize; ++lane) {
+			auto matrix = reinterpret_cast<float*>(destination + (index + lane) * stride);
+			_mm_storeu_ps(matrix + 0, columns[0][lane]);
+			_mm_storeu_ps(matrix + 4, columns[1][lane]);
+			_mm_storeu_ps(matrix + 8, columns[2][lane]);
+			_mm_storeu_ps(matrix + 12, columns[3][lane]);
+		}
+	}
+
+	updateScalar(index, last, destination, stride, rotate);
+}
+
+void TransformStore::updateScalar(size_t first, size_t last, uint8_t* destination, size_t stride, bool rotate)
+{
+	auto& table = angleTable();
+
+	for (auto index = first; index < last; ++index) {
+		auto& angle = m_Angles[index];
+		angle = angle == 359 ? 0 : angle + 1;
+		auto s = rotate ? table.sin[angle] : 0.0f;
+		auto c = rotate ? table.cos[angle] : 1.0f;
+
+		auto ax = m_AxisX[index], ay = m_AxisY[index], az = m_AxisZ[index];
+		auto tx = (1.0f - c) * ax, ty = (1.0f - c) * ay, tz = (1.0f - c) * az;
+
+		auto matrix = reinterpret_cast<float*>(destination + index * stride);
+		matrix[0] = c + tx * ax;		matrix[1] = tx * ay + s * az;	matrix[2] = tx * az - s * ay;	matrix[3] = 0.0f;
+		matrix[4] = ty * ax - s * az;	matrix[5] = c + ty * ay;		matrix[6] = ty * az + s * ax;	matrix[7] = 0.0f;
+		matrix[8] = tz * ax + s * ay;	matrix[9] = tz * ay - s * ax;	matrix[10] = c + tz * az;		matrix[11] = 0.0f;
+		matrix[12] = m_X[index];		matrix[13] = m_Y[index];		matrix[14] = m_Z[index];		matrix[15] = 1.0f;
+	}
+}
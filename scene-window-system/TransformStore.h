@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "RenderObject.h"
+
+/*
+ * The per frame transform state of every render object as a structure of arrays: positions, rotation axes
+ * (normalized once, up front) and rotation angles. update() builds the model matrices four objects at a time
+ * with SSE and writes them straight to their destination, which may be a mapped uniform buffer.
+ */
+class TransformStore
+{
+public:
+	TransformStore() = default;
+	explicit TransformStore(const std::vector<RenderObject>& renderObjects);
+
+	size_t size() const { return m_X.size(); }
+
+	// Advances the rotation of the objects in [first, last) by one degree and writes their model matrices
+	// (translation * rotation, 16 floats column major like glm::mat4) to destination + index * stride.
+	// Without rotate the matrices are translations only, the angles advance all the same.
+	void update(size_t first, size_t last, uint8_t* destination, size_t stride, bool rotate);
+
+private:
+	void updateScalar(size_t first, size_t last, uint8_t* destination, size_t stride, bool rotate);
+
+	std::vector<float> m_X, m_Y, m_Z;
+	std::vector<float> m_AxisX, m_AxisY, m_AxisZ;	//<-- unit length
+	std::vector<int32_t> m_Angles;	//<-- degrees, [0, 360)
+};
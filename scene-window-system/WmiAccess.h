@@ -49,7 +49,8 @@ public:
 		IAVertices,
 		PSInvocations,
 		VSInvocations,
-		CommandListId;
+		CommandListId,
+		Frame;
 };
 
 template<class T>
@@ -142,7 +143,8 @@ inline std::string DataCollection<PipelineStatisticsDataItem>::MakeString(std::s
 	result << "IAPrimitives" << seperator;
 	result << "IAVertices" << seperator;
 	result << "PSInvocations" << seperator;
-	result << "VSInvocations" << std::endl;
+	result << "VSInvocations" << seperator;
+	result << "Frame" << std::endl;
 
 	//data:
 	for (auto& item : items) {
@@ -157,7 +159,8 @@ inline std::string DataCollection<PipelineStatisticsDataItem>::MakeString(std::s
 		result << item.IAPrimitives << seperator;
 		result << item.IAVertices << seperator;
 		result << item.PSInvocations << seperator;
-		result << item.VSInvocations << std::endl;
+		result << item.VSInvocations << seperator;
+		result << item.Frame << std::endl;
 	}
 
 	return result.str();